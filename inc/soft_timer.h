@@ -12,19 +12,225 @@
 #define __SOFT_TIMER_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 
-#include "tim.h"
+/**
+ * @brief Optional header with the module configuration, given by the build.
+ *
+ * @note e.g. -DSOFT_TIMER_CONFIG_FILE=\"soft_timer_config.h\"
+ */
+#if defined(SOFT_TIMER_CONFIG_FILE)
+#include SOFT_TIMER_CONFIG_FILE
+#endif
 
 /*****************************************
  * Public Constants
  *****************************************/
 
+/**
+ * @brief Number of timers in the pool of each scheduler.
+ *
+ * @note See @ref soft_timer_create.
+ */
+#if !defined(SOFT_TIMER_MAX_TIMERS)
 #define SOFT_TIMER_MAX_TIMERS 10
+#endif
+
+/**
+ * @brief Maximum number of timers created in user memory at the same time.
+ *
+ * @note See @ref soft_timer_create_static.
+ */
+#if !defined(SOFT_TIMER_MAX_STATIC_TIMERS)
+#define SOFT_TIMER_MAX_STATIC_TIMERS 4
+#endif
+
+/**
+ * @brief Maximum number of schedulers, each bound to one hardware timer.
+ *
+ * @note Each scheduler has its own pool of SOFT_TIMER_MAX_TIMERS timers.
+ */
+#if !defined(SOFT_TIMER_MAX_SCHEDULERS)
+#define SOFT_TIMER_MAX_SCHEDULERS 1
+#endif
+
+/**
+ * @brief Packs timer instances to save RAM.
+ *
+ * @note Reload and slack values are limited to 0xFFFF timer ticks.
+ */
+#if !defined(SOFT_TIMER_PACKED)
+#define SOFT_TIMER_PACKED 0
+#endif
+
+/**
+ * @brief Available hardware timers.
+ *
+ * @note - TIM: general purpose timer, stops counting in STOP mode.
+ * @note - LPTIM: low power timer, keeps counting in STOP mode so the
+ *       device may sleep until the next timeout.
+ * @note - Host: simulated timer for running the module off target, time
+ *       only passes through @ref soft_timer_host_advance.
+ */
+#define SOFT_TIMER_HARDWARE_TIM   0
+#define SOFT_TIMER_HARDWARE_LPTIM 1
+#define SOFT_TIMER_HARDWARE_HOST  2
+
+#if !defined(SOFT_TIMER_HARDWARE)
+#define SOFT_TIMER_HARDWARE SOFT_TIMER_HARDWARE_TIM
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_LPTIM
+#include "lptim.h"
+#elif SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+#include <stddef.h>
+#else
+#include "tim.h"
+
+/**
+ * @brief Hardware timer compare channel used to schedule timeouts.
+ */
+#if !defined(SOFT_TIMER_TIM_CHANNEL)
+#define SOFT_TIMER_TIM_CHANNEL TIM_CHANNEL_1
+#endif
+
+#endif
+
+/**
+ * @brief Returned by next expiry queries when no timer is running.
+ */
+#define SOFT_TIMER_NO_EXPIRY (0xFFFFFFFF)
+
+/**
+ * @brief Available scheduling backends.
+ *
+ * @note - List: running timers are kept in a sorted delta list. Smallest
+ *       footprint, start and stop are linear in the number of running timers.
+ * @note - Wheel: running timers are kept in a hierarchical timing wheel.
+ *       Start, stop and restart are constant time, at the cost of one list
+ *       head per wheel slot and extra cascade updates for long timeouts.
+ * @note - Scan: deadlines are kept in an array indexed by timer id and
+ *       scanned on every update. Start and stop are constant time and the
+ *       scan goes through contiguous memory, suits many short timers.
+ *       Timers expired in the same update are called back in id order.
+ */
+#define SOFT_TIMER_BACKEND_LIST  0
+#define SOFT_TIMER_BACKEND_WHEEL 1
+#define SOFT_TIMER_BACKEND_SCAN  2
+
+#if !defined(SOFT_TIMER_BACKEND)
+#define SOFT_TIMER_BACKEND SOFT_TIMER_BACKEND_LIST
+#endif
+
+/**
+ * @brief Number of timing wheel levels, each level has 32 slots.
+ *
+ * @note Timeouts up to 32^levels milliseconds are placed directly, longer
+ *       ones are cascaded again from the last level.
+ */
+#if !defined(SOFT_TIMER_WHEEL_LEVELS)
+#define SOFT_TIMER_WHEEL_LEVELS 4
+#endif
+
+/**
+ * @brief Deferred callbacks mode.
+ *
+ * @note When enabled, timer interrupts only queue expired timers and
+ *       callbacks are called from @ref soft_timer_dispatch.
+ */
+#if !defined(SOFT_TIMER_DEFERRED_CALLBACKS)
+#define SOFT_TIMER_DEFERRED_CALLBACKS 0
+#endif
+
+/**
+ * @brief Enables calling start and stop from any interrupt or task.
+ *
+ * @note When enabled, calls made outside the timer interrupt only post a
+ *       command and request the compare interrupt, which applies it.
+ */
+#if !defined(SOFT_TIMER_CONCURRENT_API)
+#define SOFT_TIMER_CONCURRENT_API 0
+#endif
+
+/**
+ * @brief Enables run time statistics, see @ref soft_timer_stats_get.
+ *
+ * @note Cycles are counted with DWT->CYCCNT, which is enabled on
+ *       initialization. Not available on Cortex-M0/M0+.
+ */
+#if !defined(SOFT_TIMER_STATS)
+#define SOFT_TIMER_STATS 0
+#endif
+
+/**
+ * @brief Number of callback priority levels, from 1 to 8.
+ *
+ * @note Callbacks of timers expiring together are called highest priority
+ *       first, 0 being the highest. With deferred callbacks, each level has
+ *       its own ready queue, see @ref soft_timer_dispatch_priority.
+ */
+#if !defined(SOFT_TIMER_PRIORITY_LEVELS)
+#define SOFT_TIMER_PRIORITY_LEVELS 1
+#endif
+
+/**
+ * @brief Enables the FreeRTOS adapter, see soft_timer_rtos.h.
+ *
+ * @note Requires deferred callbacks, which are called from service tasks.
+ */
+#if !defined(SOFT_TIMER_RTOS)
+#define SOFT_TIMER_RTOS 0
+#endif
+
+/**
+ * @brief Enables the trace of timer activity, see @ref soft_timer_trace_read.
+ */
+#if !defined(SOFT_TIMER_TRACE)
+#define SOFT_TIMER_TRACE 0
+#endif
+
+/**
+ * @brief Number of events kept by the trace, a power of two.
+ *
+ * @note Events recorded while the buffer is full are dropped and counted.
+ */
+#if !defined(SOFT_TIMER_TRACE_SIZE)
+#define SOFT_TIMER_TRACE_SIZE 64
+#endif
 
 /*****************************************
  * Public Types
  *****************************************/
 
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+
+/**
+ * @brief Simulated hardware timer.
+ *
+ * @note Behaves as a free running counter with one compare channel, its
+ *       interrupts are run by @ref soft_timer_host_advance.
+ */
+typedef struct soft_timer_host_timer {
+    uint32_t counter;          /**< Counter value. */
+    uint32_t compare;          /**< Compare value. */
+    bool     compare_enabled;  /**< Compare interrupt enable. */
+    bool     compare_pending;  /**< Compare interrupt flag. */
+    bool     overflow_pending; /**< Overflow interrupt flag. */
+} soft_timer_host_timer_t;
+
+#endif
+
+/**
+ * @brief HAL handler type of the hardware timer in use.
+ */
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_LPTIM
+typedef LPTIM_HandleTypeDef soft_timer_handle_t;
+#elif SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+typedef soft_timer_host_timer_t soft_timer_handle_t;
+#else
+typedef TIM_HandleTypeDef soft_timer_handle_t;
+#endif
+
 /**
  * @brief Forward declaration of software timer instance.
  *
@@ -33,6 +239,31 @@
  */
 typedef struct soft_timer soft_timer_t;
 
+/**
+ * @brief Forward declaration of scheduler instance.
+ *
+ * @note A scheduler runs timers on one hardware timer. Internals are
+ *       not known by the user.
+ */
+typedef struct soft_timer_scheduler soft_timer_scheduler_t;
+
+/**
+ * @brief Memory for a software timer instance outside the timer pool.
+ *
+ * @note Contents are private, size is checked at compile time to fit
+ *       a timer instance.
+ */
+typedef struct soft_timer_storage {
+    uint32_t reserved_words[10];
+    void*    p_reserved[5];
+#if SOFT_TIMER_STATS
+    uint32_t reserved_stats;
+#endif
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    void*    p_reserved_priority;
+#endif
+} soft_timer_storage_t;
+
 /**
  * @brief Timer timeout callback.
  *
@@ -50,8 +281,87 @@ typedef enum soft_timer_status {
     SOFT_TIMER_STATUS_SUCCESS = 0,
     SOFT_TIMER_STATUS_INVALID_PARAMETER,
     SOFT_TIMER_STATUS_INVALID_STATE,
+    SOFT_TIMER_STATUS_TIMEOUT,
 } soft_timer_status_t;
 
+/**
+ * @brief Timeout guard for polling loops, see @ref soft_timer_timeout_start.
+ */
+typedef struct soft_timer_timeout {
+    soft_timer_scheduler_t* p_scheduler;    /**< Scheduler whose time base is used. */
+    uint32_t                deadline_ticks; /**< Time at which the guard expires. */
+} soft_timer_timeout_t;
+
+/**
+ * @brief Policies for periods of a repeating timer missed by a late interrupt.
+ */
+typedef enum soft_timer_catch_up {
+    SOFT_TIMER_CATCH_UP_BURST = 0, /**< Every missed period times out, back to back. */
+    SOFT_TIMER_CATCH_UP_SKIP,      /**< Missed periods are dropped, keeping the period phase. */
+    SOFT_TIMER_CATCH_UP_REPORT,    /**< As skip, counting dropped periods in @ref soft_timer_overruns_get. */
+} soft_timer_catch_up_t;
+
+/**
+ * @brief Time scaling computed at initialization.
+ *
+ * @note Reload values in time units are converted to ticks with these
+ *       factors, using only integer operations. They come from the exact
+ *       ratio clock_hz / (prescaler + 1), tick_frequency_hz is rounded.
+ */
+typedef struct soft_timer_scaling {
+    uint32_t tick_frequency_hz; /**< Actual timer tick frequency. */
+    uint32_t prescaler;         /**< Hardware prescaler register value. */
+    uint32_t clock_hz;          /**< Hardware timer input clock, before the prescaler. */
+    uint32_t resolution_ns;     /**< Tick period, rounded to nanoseconds. */
+    int32_t  error_ppm;         /**< Deviation from the requested tick frequency, in parts per million, saturated. */
+    uint64_t ticks_per_ms_q32;  /**< Timer ticks per millisecond, Q32.32 fixed point. */
+    uint64_t ticks_per_us_q32;  /**< Timer ticks per microsecond, Q32.32 fixed point. */
+} soft_timer_scaling_t;
+
+/**
+ * @brief Run time statistics of a scheduler.
+ *
+ * @note Averages are given by the totals divided by the counts. Cycles are
+ *       CPU cycles, lateness is measured in timer ticks from the (slack
+ *       delayed) deadline to the callback call.
+ */
+typedef struct soft_timer_stats {
+    uint32_t isr_count;             /**< Compare interrupts handled. */
+    uint32_t isr_cycles_last;       /**< Cycles spent in the last compare interrupt. */
+    uint32_t isr_cycles_max;        /**< Max cycles spent in a compare interrupt. */
+    uint64_t isr_cycles_total;      /**< Cycles spent in all compare interrupts. */
+    uint32_t isr_expired_max;       /**< Max timers expired in a compare interrupt. */
+    uint32_t expired_count;         /**< Timer expirations. */
+    uint32_t lateness_ticks_max;    /**< Max timer lateness. */
+    uint64_t lateness_ticks_total;  /**< Lateness of all timer expirations. */
+    uint32_t callback_cycles_max;   /**< Max cycles spent in a timer callback. */
+} soft_timer_stats_t;
+
+/**
+ * @brief Types of trace events.
+ */
+typedef enum soft_timer_trace_type {
+    SOFT_TIMER_TRACE_NONE = 0, /**< Slot not written yet, never read. */
+    SOFT_TIMER_TRACE_START,    /**< Timer armed, value is its nominal deadline. */
+    SOFT_TIMER_TRACE_STOP,     /**< Running timer cancelled or finished. */
+    SOFT_TIMER_TRACE_EXPIRE,   /**< Timer expired, value is its nominal deadline. */
+    SOFT_TIMER_TRACE_COMPARE,  /**< Hardware compare programmed, value is its deadline. */
+    SOFT_TIMER_TRACE_IDLE,     /**< Hardware compare stopped, no timer running. */
+} soft_timer_trace_type_t;
+
+/**
+ * @brief Trace event, see @ref soft_timer_trace_read.
+ *
+ * @note Times and values are in the time base of @ref soft_timer_now.
+ */
+typedef struct soft_timer_trace_event {
+    uint32_t time;      /**< Time at which the event was recorded. */
+    uint32_t value;     /**< Event value, see soft_timer_trace_type_t. */
+    uint8_t  type;      /**< Event type, a soft_timer_trace_type_t. */
+    uint8_t  timer_id;  /**< Sequential timer id, 0 for compare events. */
+    uint8_t  scheduler; /**< Scheduler index, in initialization order. */
+} soft_timer_trace_event_t;
+
 /*****************************************
  * Public Functions Prototypes
  *****************************************/
@@ -59,10 +369,33 @@ typedef enum soft_timer_status {
 /**
  * @brief Initialize software timer module.
  *
+ * @note The hardware timer is left free running and its compare channel
+ *       @ref SOFT_TIMER_TIM_CHANNEL is used to interrupt on timeouts.
+ * @note The module functions that do not take a scheduler use the one
+ *       initialized first, called default scheduler.
+ * @note Timeouts are not limited by the counter size, longer ones span
+ *       many counter periods, up to 0x7FFFFFFF timer ticks.
+ *
  * @param htim          Pointer to HAL Timer handler
- * @param max_reload_ms Maximum timer value, usually 0xFFFF or 0xFFFFFFFF
+ * @param max_reload_ms Hardware timer counter max value, usually 0xFFFF or 0xFFFFFFFF
+ */
+void soft_timer_init(soft_timer_handle_t* htim, uint32_t max_reload_ms);
+
+/**
+ * @brief Initialize software timer module with given tick resolution.
+ *
+ * @note The TIM prescaler is the nearest integer divider of the timer clock,
+ *       so the actual tick frequency may differ from the requested one, see
+ *       @ref soft_timer_scaling_get for the achieved resolution and error.
+ * @note With LPTIM hardware the prescaler is not changed, tick frequency
+ *       must be the configured LPTIM counter frequency, e.g. 32768 for LSE.
+ *
+ * @param htim              Pointer to HAL Timer handler
+ * @param max_reload_ms     Hardware timer counter max value, usually 0xFFFF or 0xFFFFFFFF
+ * @param tick_frequency_hz Timer tick frequency, e.g. 1000 for millisecond
+ *                          or 1000000 for microsecond resolution
  */
-void soft_timer_init(TIM_HandleTypeDef* htim, uint32_t max_reload_ms);
+void soft_timer_init_ex(soft_timer_handle_t* htim, uint32_t max_reload_ms, uint32_t tick_frequency_hz);
 
 /**
  * @brief Allocates and initializes a software timer instance.
@@ -72,6 +405,19 @@ void soft_timer_init(TIM_HandleTypeDef* htim, uint32_t max_reload_ms);
  */
 soft_timer_t* soft_timer_create(void);
 
+/**
+ * @brief Initializes a software timer instance in user memory.
+ *
+ * @note Storage must stay valid until the timer is destroyed.
+ *
+ * @param p_storage Pointer to memory to hold the timer instance.
+ *
+ * @return Pointer to initialized timer.
+ * @retval NULL Returns null if SOFT_TIMER_MAX_STATIC_TIMERS timers are
+ *              already created in user memory.
+ */
+soft_timer_t* soft_timer_create_static(soft_timer_storage_t* p_storage);
+
 /**
  * @brief Dellocates software timer instance.
  *
@@ -87,12 +433,12 @@ void soft_timer_destroy(soft_timer_t** timer);
  *
  * @note - This function will configure a timer instance that is stopped.
  *       Only configured timers may be started.
- * @note - The reload value must be at least 2 and at most the maximum
+ * @note - The reload value must be at least 1 tick and at most the maximum
  *       value recalculated deppending on the timer frequency.
  *
  * @param timer     Pointer to timer instance to be configured.
  * @param callback  Pointer to timeout callback function.
- * @param reload_ms Value to reload timer in milliseconds (min 2).
+ * @param reload_ms Value to reload timer in milliseconds.
  * @param repeat    Boolean flag signalling if timer should repeat after timeout.
  *
  * @return Operation status.
@@ -100,11 +446,191 @@ void soft_timer_destroy(soft_timer_t** timer);
 soft_timer_status_t soft_timer_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
                                    bool repeat);
 
+/**
+ * @brief Configures timer with reload in microseconds.
+ *
+ * @note Same as @ref soft_timer_set, reload is rounded to the nearest tick.
+ *
+ * @param timer     Pointer to timer instance to be configured.
+ * @param callback  Pointer to timeout callback function.
+ * @param reload_us Value to reload timer in microseconds.
+ * @param repeat    Boolean flag signalling if timer should repeat after timeout.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_set_us(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_us,
+                                      bool repeat);
+
+/**
+ * @brief Configures timer with reload in timer ticks.
+ *
+ * @note Same as @ref soft_timer_set, tick length is given by
+ *       @ref soft_timer_tick_frequency_get.
+ *
+ * @param timer        Pointer to timer instance to be configured.
+ * @param callback     Pointer to timeout callback function.
+ * @param reload_ticks Value to reload timer in timer ticks (min 1).
+ * @param repeat       Boolean flag signalling if timer should repeat after timeout.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_set_ticks(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ticks,
+                                         bool repeat);
+
+/**
+ * @brief Configures timer allowing its timeout to be delayed by up to a slack time.
+ *
+ * @note Within the slack window the timeout is moved to a tick aligned to a
+ *       power of two, so timers with overlapping windows tend to expire in
+ *       the same hardware interrupt.
+ * @note Repeating timers keep their nominal period, slack is applied to each
+ *       timeout without accumulating.
+ *
+ * @param timer     Pointer to timer instance to be configured.
+ * @param callback  Pointer to timeout callback function.
+ * @param reload_ms Value to reload timer in milliseconds.
+ * @param repeat    Boolean flag signalling if timer should repeat after timeout.
+ * @param slack_ms  Maximum timeout delay in milliseconds.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_set_ex(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
+                                      bool repeat, uint32_t slack_ms);
+
+/**
+ * @brief Changes the reload value of a timer, which may be running.
+ *
+ * @note By default the new period starts at the next timeout, keeping the
+ *       current one. Immediately, the current timeout is moved to the start
+ *       of the current period plus the new period, or to now if already
+ *       passed. Called from the timer callback, both take effect on the
+ *       next period.
+ * @note The hardware timer is only reprogrammed if the next deadline of the
+ *       scheduler gets earlier.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the period is actually changed and the timer state
+ *       is not checked.
+ *
+ * @param timer     Pointer to timer instance.
+ * @param period_ms New reload value in milliseconds.
+ * @param immediate Whether the current timeout is moved to the new period.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_set_period(soft_timer_t* timer, uint32_t period_ms, bool immediate);
+
+/**
+ * @brief Changes the reload value of a timer in timer ticks, which may be running.
+ *
+ * @note Same as @ref soft_timer_set_period.
+ *
+ * @param timer        Pointer to timer instance.
+ * @param period_ticks New reload value in timer ticks.
+ * @param immediate    Whether the current timeout is moved to the new period.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_set_period_ticks(soft_timer_t* timer, uint32_t period_ticks, bool immediate);
+
+/**
+ * @brief Sets user context of timer.
+ *
+ * @note Meant to find the owner of a timer in its callback, so one callback
+ *       may be shared by many timers. Context is cleared on timer creation.
+ *
+ * @param timer     Pointer to timer instance.
+ * @param p_context User context, given back by @ref soft_timer_context_get.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_context_set(soft_timer_t* timer, void* p_context);
+
+/**
+ * @brief Gets user context of timer.
+ *
+ * @param timer Pointer to timer instance.
+ *
+ * @return User context set by @ref soft_timer_context_set.
+ * @retval NULL Returns null if no context was set.
+ */
+void* soft_timer_context_get(soft_timer_t* timer);
+
+/**
+ * @brief Sets how a repeating timer handles periods missed by a late interrupt.
+ *
+ * @note Time of the skipping policies is computed once, so the callback is
+ *       called a single time however late the interrupt was, and the next
+ *       timeout is the first period boundary still ahead. Policy is set to
+ *       @ref SOFT_TIMER_CATCH_UP_BURST on timer creation.
+ *
+ * @param timer    Pointer to timer instance.
+ * @param catch_up Catch up policy.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_catch_up_set(soft_timer_t* timer, soft_timer_catch_up_t catch_up);
+
+/**
+ * @brief Gets periods dropped since the last call of this function.
+ *
+ * @note Only counted with @ref SOFT_TIMER_CATCH_UP_REPORT, meant to be called
+ *       from the callback so it can make up for the lost periods. With
+ *       deferred callbacks, timeouts merged while waiting for dispatch are
+ *       counted too.
+ *
+ * @param timer Pointer to timer instance.
+ *
+ * @return Number of dropped periods.
+ */
+uint32_t soft_timer_overruns_get(soft_timer_t* timer);
+
+/**
+ * @brief Sets callback priority of timer.
+ *
+ * @note Only orders callbacks of timers expiring together, a running
+ *       callback is never preempted by the module. Priority is set to the
+ *       lowest level on timer creation.
+ *
+ * @param timer    Pointer to timer instance.
+ * @param priority Priority level, 0 is the highest, up to SOFT_TIMER_PRIORITY_LEVELS - 1.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_priority_set(soft_timer_t* timer, uint8_t priority);
+
+/**
+ * @brief Gets actual timer tick frequency.
+ *
+ * @return Tick frequency in Hz.
+ */
+uint32_t soft_timer_tick_frequency_get(void);
+
+/**
+ * @brief Gets time scaling computed at initialization.
+ *
+ * @param p_scaling Pointer to store the scaling factors.
+ */
+void soft_timer_scaling_get(soft_timer_scaling_t* p_scaling);
+
+/**
+ * @brief Gets current time of the monotonic time base.
+ *
+ * @note Hardware counter extended by counted overflows and by time slept
+ *       with @ref soft_timer_sleep_compensate_ms. Wraps around at 32 bits,
+ *       times must be compared by their signed difference.
+ *
+ * @return Current time in timer ticks.
+ */
+uint32_t soft_timer_now(void);
+
 /**
  * @brief Starts timer.
  *
  * @note Timer must be previously configured with @ref soft_timer_set
  *       and must be stopped.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timer is actually started and the timer state
+ *       is not checked. Timer starting time is still the time of the call.
  *
  * @param timer Pointer to timer instance to be started.
  *
@@ -116,6 +642,9 @@ soft_timer_status_t soft_timer_start(soft_timer_t* timer);
  * @brief Stops timer.
  *
  * @note Timer must be started.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timer is actually stopped and the timer state
+ *       is not checked.
  *
  * @param timer Pointer to timer instance to be stopped.
  *
@@ -123,6 +652,105 @@ soft_timer_status_t soft_timer_start(soft_timer_t* timer);
  */
 soft_timer_status_t soft_timer_stop(soft_timer_t* timer);
 
+/**
+ * @brief Restarts timer countdown from now, starting it if stopped.
+ *
+ * @note Cheaper than stopping and starting again, the hardware timer is
+ *       only reprogrammed if the next timeout changes.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timer is actually restarted and the timer state
+ *       is not checked. Countdown still starts at the time of the call.
+ *
+ * @param timer Pointer to timer instance to be restarted.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_restart(soft_timer_t* timer);
+
+/**
+ * @brief Restarts countdown of a running timer from now.
+ *
+ * @note Timer must be started, meant for watchdog-like timeouts pushed
+ *       back on every event.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the countdown is actually reset and the timer state
+ *       is not checked. Countdown still starts at the time of the call.
+ *
+ * @param timer Pointer to timer instance.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_reset_countdown(soft_timer_t* timer);
+
+/**
+ * @brief Starts a group of timers from the same instant.
+ *
+ * @note Time is read once and the hardware timer is reprogrammed once, so
+ *       timers with equal periods stay aligned. All timers must belong to
+ *       the same scheduler and be stopped, otherwise none is started.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timers are actually started and their states
+ *       are not checked. Countdowns still start at the time of the call.
+ *
+ * @param p_timers Array of pointers to timer instances.
+ * @param count    Number of timers in the array.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_start_group(soft_timer_t* const* p_timers, uint16_t count);
+
+/**
+ * @brief Stops a group of timers.
+ *
+ * @note Hardware timer is reprogrammed once. All timers must belong to the
+ *       same scheduler and be started, otherwise none is stopped.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timers are actually stopped and their states
+ *       are not checked.
+ *
+ * @param p_timers Array of pointers to timer instances.
+ * @param count    Number of timers in the array.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_stop_group(soft_timer_t* const* p_timers, uint16_t count);
+
+/**
+ * @brief Starts timer with its first timeout at an absolute time.
+ *
+ * @note Later periods of a repeating timer count from the given deadline.
+ *       A deadline already passed makes the timer expire right away, with
+ *       later periods counted from the time of the call.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timer is actually started and the timer state
+ *       is not checked.
+ *
+ * @param timer          Pointer to timer instance to be started.
+ * @param deadline_ticks First timeout time, in the time base of @ref soft_timer_now.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_start_at(soft_timer_t* timer, uint32_t deadline_ticks);
+
+/**
+ * @brief Starts timer phase aligned to a running reference timer.
+ *
+ * @note First timeout is the earliest one still ahead at given phase after
+ *       a timeout of the reference, with the phase taken modulo the period
+ *       of a repeating reference. Timers with the same period then keep
+ *       their phase, as slots of a TDMA frame.
+ * @note With SOFT_TIMER_CONCURRENT_API, a call outside the timer interrupt
+ *       returns before the timer is actually started and the timer state
+ *       is not checked.
+ *
+ * @param timer       Pointer to timer instance to be started.
+ * @param reference   Pointer to running timer of the same scheduler.
+ * @param phase_ticks Delay after the reference timeouts in timer ticks.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_start_aligned(soft_timer_t* timer, soft_timer_t* reference, uint32_t phase_ticks);
+
 /**
  * @brief Checks if a timer is stopped.
  *
@@ -132,6 +760,486 @@ soft_timer_status_t soft_timer_stop(soft_timer_t* timer);
  */
 bool soft_timer_is_stopped(soft_timer_t* timer);
 
+/**
+ * @brief Gets time until the next timer expires.
+ *
+ * @note Meant for the idle loop to decide how long it may sleep.
+ *
+ * @return Time until next timeout in milliseconds, rounded down.
+ * @retval SOFT_TIMER_NO_EXPIRY No timer is running.
+ */
+uint32_t soft_timer_next_expiry_ms(void);
+
+/**
+ * @brief Gets time until the next timer expires in timer ticks.
+ *
+ * @return Time until next timeout in timer ticks.
+ * @retval SOFT_TIMER_NO_EXPIRY No timer is running.
+ */
+uint32_t soft_timer_next_expiry_ticks(void);
+
+/**
+ * @brief Accounts time in which the hardware timer was not counting.
+ *
+ * @note To be called after waking up from a low power mode that stops
+ *       the hardware timer, with the time slept measured by another clock
+ *       (e.g. RTC). Timers that expired while sleeping are updated.
+ *
+ * @param sleep_time_ms Time slept in milliseconds.
+ */
+void soft_timer_sleep_compensate_ms(uint32_t sleep_time_ms);
+
+/**
+ * @brief Waits for given time, sleeping until a one-shot timer expires.
+ *
+ * @note A timer is taken from the pool for the wait, so other interrupts
+ *       still run and the core sleeps in @ref soft_timer_wait_idle.
+ * @note To be called from thread level with interrupts enabled, never
+ *       from the timer interrupt nor from callbacks called by it. Deferred
+ *       callbacks are not dispatched while waiting. Under an RTOS, blocks
+ *       every task, see soft_timer_rtos_delay_ms instead.
+ *
+ * @param delay_ms Time to wait in milliseconds.
+ *
+ * @retval SOFT_TIMER_STATUS_SUCCESS           Time elapsed.
+ * @retval SOFT_TIMER_STATUS_INVALID_PARAMETER Delay longer than the maximum reload.
+ * @retval SOFT_TIMER_STATUS_INVALID_STATE     No timer available in the pool.
+ */
+soft_timer_status_t soft_timer_delay_ms(uint32_t delay_ms);
+
+/**
+ * @brief Waits for an event flag, sleeping until it is set or a timeout.
+ *
+ * @note The flag is set by an interrupt, which also wakes the core. Same
+ *       restrictions as @ref soft_timer_delay_ms.
+ *
+ * @param p_event    Flag set when the event happens.
+ * @param timeout_ms Maximum time to wait in milliseconds.
+ *
+ * @retval SOFT_TIMER_STATUS_SUCCESS           Event flag set.
+ * @retval SOFT_TIMER_STATUS_TIMEOUT           Time elapsed before the event.
+ * @retval SOFT_TIMER_STATUS_INVALID_PARAMETER NULL flag or timeout longer than the maximum reload.
+ * @retval SOFT_TIMER_STATUS_INVALID_STATE     No timer available in the pool.
+ */
+soft_timer_status_t soft_timer_wait(volatile bool* p_event, uint32_t timeout_ms);
+
+/**
+ * @brief Starts a timeout guard for a polling loop.
+ *
+ * @note No timer is used, the guard only compares the time base, e.g.
+ *       while (!flag && !soft_timer_timeout_expired(&timeout)) {}.
+ *
+ * @param p_timeout  Pointer to guard to be started.
+ * @param timeout_ms Timeout in milliseconds.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_timeout_start(soft_timer_timeout_t* p_timeout, uint32_t timeout_ms);
+
+/**
+ * @brief Checks if a timeout guard expired.
+ *
+ * @param p_timeout Pointer to guard started by @ref soft_timer_timeout_start.
+ *
+ * @return true if the timeout elapsed, false otherwise.
+ */
+bool soft_timer_timeout_expired(const soft_timer_timeout_t* p_timeout);
+
+/**
+ * @brief Handles hardware timer counter overflow.
+ *
+ * @note Must be called from HAL_TIM_PeriodElapsedCallback (or
+ *       HAL_LPTIM_AutoReloadMatchCallback) for the timer handler given
+ *       to @ref soft_timer_init.
+ *
+ * @note The HAL handler clears the overflow flag before this callback, so
+ *       an interrupt of higher priority preempting it in between reads a
+ *       time one counter period behind. Use @ref soft_timer_irq_handler
+ *       when the API is called from such interrupts.
+ */
 void soft_timer_period_elapsed_callback(void);
 
+/**
+ * @brief Handles hardware timer compare event, updating expired timers.
+ *
+ * @note Must be called from HAL_TIM_OC_DelayElapsedCallback (or
+ *       HAL_LPTIM_CompareMatchCallback) for the timer handler given
+ *       to @ref soft_timer_init.
+ */
+void soft_timer_output_compare_callback(void);
+
+/**
+ * @brief Initializes a scheduler bound to given hardware timer.
+ *
+ * @note Same as @ref soft_timer_init_ex, but gives a scheduler handler
+ *       so more than one hardware timer can be used.
+ * @note If given hardware timer is already bound, its scheduler is returned
+ *       unchanged, the counter size and tick frequency are not applied again.
+ *
+ * @param htim              Pointer to HAL Timer handler
+ * @param max_reload_ms     Hardware timer counter max value, usually 0xFFFF or 0xFFFFFFFF
+ * @param tick_frequency_hz Timer tick frequency
+ *
+ * @return Pointer to scheduler.
+ * @retval NULL Returns null if SOFT_TIMER_MAX_SCHEDULERS are already in use.
+ */
+soft_timer_scheduler_t* soft_timer_scheduler_init(soft_timer_handle_t* htim, uint32_t max_reload_ms,
+                                                  uint32_t tick_frequency_hz);
+
+/**
+ * @brief Gets the scheduler bound to given hardware timer.
+ *
+ * @note Meant for routing HAL callbacks, which only give the timer handler.
+ *
+ * @param htim Pointer to HAL Timer handler
+ *
+ * @return Pointer to scheduler.
+ * @retval NULL Returns null if no scheduler is bound to given timer.
+ */
+soft_timer_scheduler_t* soft_timer_scheduler_get(soft_timer_handle_t* htim);
+
+/**
+ * @brief Allocates a software timer instance from the pool of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return Pointer to allocated timer.
+ * @retval NULL Returns null if no free timer is available.
+ */
+soft_timer_t* soft_timer_scheduler_timer_create(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Initializes a software timer instance in user memory run by given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_storage   Pointer to memory to hold the timer instance.
+ *
+ * @return Pointer to initialized timer.
+ * @retval NULL Returns null if SOFT_TIMER_MAX_STATIC_TIMERS timers are
+ *              already created in user memory for given scheduler.
+ */
+soft_timer_t* soft_timer_scheduler_timer_create_static(soft_timer_scheduler_t* p_scheduler,
+                                                       soft_timer_storage_t* p_storage);
+
+/**
+ * @brief Gets the actual tick frequency of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return Timer tick frequency in Hz.
+ */
+uint32_t soft_timer_scheduler_tick_frequency_get(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Gets the time scaling of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_scaling   Pointer to store scaling.
+ */
+void soft_timer_scheduler_scaling_get(soft_timer_scheduler_t* p_scheduler, soft_timer_scaling_t* p_scaling);
+
+/**
+ * @brief Gets current time of given scheduler time base.
+ *
+ * @param p_scheduler Pointer to scheduler instance.
+ *
+ * @return Current time in timer ticks.
+ */
+uint32_t soft_timer_scheduler_now(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Gets time until the next timer of given scheduler expires.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return Time until next timeout in milliseconds, rounded down.
+ * @retval SOFT_TIMER_NO_EXPIRY No timer is running.
+ */
+uint32_t soft_timer_scheduler_next_expiry_ms(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Gets time until the next timer of given scheduler expires in timer ticks.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return Time until next timeout in timer ticks.
+ * @retval SOFT_TIMER_NO_EXPIRY No timer is running.
+ */
+uint32_t soft_timer_scheduler_next_expiry_ticks(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Accounts time in which the hardware timer of given scheduler was not counting.
+ *
+ * @param p_scheduler   Pointer to scheduler.
+ * @param sleep_time_ms Time slept in milliseconds.
+ */
+void soft_timer_scheduler_sleep_compensate_ms(soft_timer_scheduler_t* p_scheduler, uint32_t sleep_time_ms);
+
+/**
+ * @brief Waits for given time, with a timer of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param delay_ms    Time to wait in milliseconds.
+ *
+ * @return Same as @ref soft_timer_delay_ms.
+ */
+soft_timer_status_t soft_timer_scheduler_delay_ms(soft_timer_scheduler_t* p_scheduler, uint32_t delay_ms);
+
+/**
+ * @brief Waits for an event flag, with a timeout timer of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_event     Flag set when the event happens.
+ * @param timeout_ms  Maximum time to wait in milliseconds.
+ *
+ * @return Same as @ref soft_timer_wait.
+ */
+soft_timer_status_t soft_timer_scheduler_wait(soft_timer_scheduler_t* p_scheduler, volatile bool* p_event,
+                                              uint32_t timeout_ms);
+
+/**
+ * @brief Starts a timeout guard in the time base of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_timeout   Pointer to guard to be started.
+ * @param timeout_ms  Timeout in milliseconds.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_scheduler_timeout_start(soft_timer_scheduler_t* p_scheduler,
+                                                       soft_timer_timeout_t* p_timeout, uint32_t timeout_ms);
+
+/**
+ * @brief Sleeps while waiting in @ref soft_timer_delay_ms or @ref soft_timer_wait.
+ *
+ * @note Called with interrupts masked, a pending interrupt must end the
+ *       sleep. Default implementation executes WFI, or on the host backend
+ *       advances the simulated timer to its next event. It may be redefined
+ *       to enter a deeper low power mode.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer being waited.
+ */
+void soft_timer_wait_idle(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Handles counter overflow of the hardware timer of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+void soft_timer_scheduler_period_elapsed_callback(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Handles compare event of the hardware timer of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+void soft_timer_scheduler_output_compare_callback(soft_timer_scheduler_t* p_scheduler);
+
+#if SOFT_TIMER_HARDWARE != SOFT_TIMER_HARDWARE_HOST
+
+/**
+ * @brief Handles the hardware timer interrupt without the HAL handler.
+ *
+ * @note To be called from the TIMx_IRQHandler (or LPTIMx_IRQHandler) of the
+ *       timer given to @ref soft_timer_init, in place of HAL_TIM_IRQHandler.
+ *       Only overflow and scheduler compare flags of the bound instance are
+ *       checked and cleared, so the hardware timer must not be shared with
+ *       other HAL callbacks.
+ *
+ * @note Overflow is counted with interrupts masked along with its flag
+ *       clear, so time read from any interrupt priority stays consistent.
+ */
+void soft_timer_irq_handler(void);
+
+/**
+ * @brief Handles the interrupt of the hardware timer of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+void soft_timer_scheduler_irq_handler(soft_timer_scheduler_t* p_scheduler);
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_TIM
+
+/**
+ * @brief Starts a periodic hardware trigger on a spare TIM.
+ *
+ * @note The trigger TIM counts on its own, with prescaler and auto reload
+ *       set to the period, so it runs with no CPU cycles per period. Its
+ *       TRGO and channel modes stay in the CubeMX configuration, e.g. TRGO
+ *       on update for an ADC, or a channel in PWM or toggle mode for a pin.
+ * @note Period is converted from scheduler ticks to the trigger TIM clock,
+ *       rounded to a whole number of its cycles. It must span at least two
+ *       cycles and at most 65536 counter periods.
+ * @note The update event loading the prescaler also gives a first trigger.
+ *
+ * @param htim_trigger Pointer to HAL Timer handler of the trigger, not used by a scheduler.
+ * @param channel      TIM channel compared at half period, TIM_CHANNEL_ALL for TRGO only.
+ * @param period_ticks Trigger period in timer ticks.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_trigger_start(soft_timer_handle_t* htim_trigger, uint32_t channel,
+                                             uint32_t period_ticks);
+
+/**
+ * @brief Stops a hardware trigger.
+ *
+ * @param htim_trigger Pointer to HAL Timer handler of the trigger.
+ * @param channel      TIM channel of the trigger, TIM_CHANNEL_ALL for TRGO only.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_trigger_stop(soft_timer_handle_t* htim_trigger, uint32_t channel);
+
+/**
+ * @brief Starts a periodic hardware trigger with period in ticks of given scheduler.
+ *
+ * @param p_scheduler  Pointer to scheduler instance.
+ * @param htim_trigger Pointer to HAL Timer handler of the trigger, not used by a scheduler.
+ * @param channel      TIM channel compared at half period, TIM_CHANNEL_ALL for TRGO only.
+ * @param period_ticks Trigger period in timer ticks.
+ *
+ * @return Operation status.
+ */
+soft_timer_status_t soft_timer_scheduler_trigger_start(soft_timer_scheduler_t* p_scheduler,
+                                                       soft_timer_handle_t* htim_trigger, uint32_t channel,
+                                                       uint32_t period_ticks);
+
+#endif
+
+#if SOFT_TIMER_STATS
+
+/**
+ * @brief Gets run time statistics of the default scheduler.
+ *
+ * @note Statistics updated by the timer interrupt while being copied may
+ *       be inconsistent, call with the interrupt masked if needed.
+ *
+ * @param p_stats Pointer to store statistics.
+ */
+void soft_timer_stats_get(soft_timer_stats_t* p_stats);
+
+/**
+ * @brief Clears run time statistics of the default scheduler.
+ */
+void soft_timer_stats_reset(void);
+
+/**
+ * @brief Gets run time statistics of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_stats     Pointer to store statistics.
+ */
+void soft_timer_scheduler_stats_get(soft_timer_scheduler_t* p_scheduler, soft_timer_stats_t* p_stats);
+
+/**
+ * @brief Clears run time statistics of given scheduler.
+ *
+ * @note Callback statistics of each timer are not cleared.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+void soft_timer_scheduler_stats_reset(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Gets max cycles spent in the callback of given timer.
+ *
+ * @param timer Pointer to timer instance.
+ *
+ * @return Max callback duration in CPU cycles.
+ */
+uint32_t soft_timer_callback_cycles_max_get(soft_timer_t* timer);
+
+#endif
+
+#if SOFT_TIMER_TRACE
+
+/**
+ * @brief Takes the oldest trace events out of the trace buffer.
+ *
+ * @note Events are written by the timer interrupt and by the API without
+ *       locks, this function must be called from a single context, e.g.
+ *       a low priority task sending them over SWO or UART.
+ *
+ * @param p_events   Array to store events.
+ * @param max_events Maximum number of events to be taken.
+ *
+ * @return Number of events taken.
+ */
+uint32_t soft_timer_trace_read(soft_timer_trace_event_t* p_events, uint32_t max_events);
+
+/**
+ * @brief Gets number of events dropped because the trace buffer was full.
+ *
+ * @return Dropped events since initialization.
+ */
+uint32_t soft_timer_trace_dropped_get(void);
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+
+/**
+ * @brief Advances time of a simulated hardware timer.
+ *
+ * @note Overflow and compare interrupts are run as they would happen on
+ *       target, so timer callbacks are called from this function. Events
+ *       already pending, as a compare set in the past, are run even if
+ *       no time is advanced.
+ *
+ * @param htim  Pointer to simulated timer.
+ * @param ticks Time to advance in timer ticks.
+ */
+void soft_timer_host_advance(soft_timer_handle_t* htim, uint32_t ticks);
+
+#endif
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+
+/**
+ * @brief Calls callbacks of timers that expired since last dispatch.
+ *
+ * @note To be called from thread level (main loop or a task), never
+ *       concurrently with itself.
+ * @note A timer that expires again before its callback is dispatched
+ *       has its callback called only once.
+ * @note Priority levels are dispatched highest first.
+ */
+void soft_timer_dispatch(void);
+
+/**
+ * @brief Calls callbacks of timers of one priority level that expired since last dispatch.
+ *
+ * @note Lets each level run at its own interrupt or task priority. Each
+ *       level must be dispatched from a single context, never concurrently
+ *       with itself or with @ref soft_timer_dispatch.
+ *
+ * @param priority Priority level to be dispatched.
+ */
+void soft_timer_dispatch_priority(uint8_t priority);
+
+/**
+ * @brief Signals that there are callbacks waiting to be dispatched.
+ *
+ * @note Called from the timer interrupt. Default implementation does nothing,
+ *       it may be redefined to pend PendSV or notify a task that calls
+ *       @ref soft_timer_dispatch.
+ */
+void soft_timer_dispatch_request(void);
+
+/**
+ * @brief Signals that there are callbacks of one priority level waiting to be dispatched.
+ *
+ * @note Called from the timer interrupt. Default implementation calls
+ *       @ref soft_timer_dispatch_request, it may be redefined to pend a
+ *       different interrupt or notify a different task for each level.
+ *
+ * @param priority Priority level with callbacks waiting.
+ */
+void soft_timer_dispatch_priority_request(uint8_t priority);
+
+#endif
+
 #endif // __SOFT_TIMER_H__
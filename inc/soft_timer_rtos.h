@@ -0,0 +1,191 @@
+/**
+ * @file soft_timer_rtos.h
+ *
+ * @brief Software timer adapter for FreeRTOS.
+ *
+ * @note Also usable under CMSIS-RTOS2 when its kernel is FreeRTOS, as
+ *       generated by STM32CubeMX.
+ */
+
+#if !defined(__SOFT_TIMER_RTOS_H__)
+#define __SOFT_TIMER_RTOS_H__
+
+#include "soft_timer.h"
+
+#if SOFT_TIMER_RTOS
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*****************************************
+ * Public Constants
+ *****************************************/
+
+/**
+ * @brief Stack size in words of each service task.
+ */
+#if !defined(SOFT_TIMER_RTOS_STACK_SIZE)
+#define SOFT_TIMER_RTOS_STACK_SIZE (configMINIMAL_STACK_SIZE * 2)
+#endif
+
+/**
+ * @brief Task notification bit used by @ref soft_timer_rtos_delay_ms.
+ */
+#if !defined(SOFT_TIMER_RTOS_DELAY_BIT)
+#define SOFT_TIMER_RTOS_DELAY_BIT (1UL << 31)
+#endif
+
+/*****************************************
+ * Public Types
+ *****************************************/
+
+/**
+ * @brief Task notified on timer expiry, see @ref soft_timer_rtos_set_notify.
+ */
+typedef struct soft_timer_rtos_notify {
+    TaskHandle_t task; /**< Task to be notified. */
+    uint32_t     bits; /**< Bits set in the task notification value. */
+} soft_timer_rtos_notify_t;
+
+/*****************************************
+ * Public Functions Prototypes
+ *****************************************/
+
+/**
+ * @brief Creates the service tasks, which call deferred timer callbacks.
+ *
+ * @note One task is created for each priority level, level 0 getting the
+ *       highest task priority, priority + SOFT_TIMER_PRIORITY_LEVELS - 1.
+ * @note To be called after @ref soft_timer_init, before the first timer expires.
+ * @note The timer interrupt must have a priority that allows calling FreeRTOS
+ *       functions, numerically at or above configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ *
+ * @param priority Task priority of the lowest priority level.
+ *
+ * @retval SOFT_TIMER_STATUS_SUCCESS       Tasks created.
+ * @retval SOFT_TIMER_STATUS_INVALID_STATE Already initialized or not enough heap.
+ */
+soft_timer_status_t soft_timer_rtos_init(UBaseType_t priority);
+
+/**
+ * @brief Enters a section where timers can't be changed by other tasks or the timer interrupt.
+ *
+ * @note Any other soft_timer function may be called from a task between
+ *       this and @ref soft_timer_rtos_unlock. Runs in a FreeRTOS critical
+ *       section, so it must be kept short.
+ */
+void soft_timer_rtos_lock(void);
+
+/**
+ * @brief Leaves the section entered by @ref soft_timer_rtos_lock.
+ */
+void soft_timer_rtos_unlock(void);
+
+/**
+ * @brief Thread safe @ref soft_timer_create.
+ *
+ * @return Pointer to timer, NULL if no timer is available.
+ */
+soft_timer_t* soft_timer_rtos_create(void);
+
+/**
+ * @brief Thread safe @ref soft_timer_destroy.
+ *
+ * @param timer Pointer to timer pointer, set to NULL.
+ */
+void soft_timer_rtos_destroy(soft_timer_t** timer);
+
+/**
+ * @brief Thread safe @ref soft_timer_set.
+ *
+ * @note Callbacks are called from the service task of the timer priority
+ *       level, so they must also use the thread safe functions.
+ *
+ * @param timer     Pointer to timer.
+ * @param callback  Function to be called on timeout.
+ * @param reload_ms Timer reload value in ms.
+ * @param repeat    Whether timer should restart after timeout.
+ *
+ * @return Same as @ref soft_timer_set.
+ */
+soft_timer_status_t soft_timer_rtos_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
+                                        bool repeat);
+
+/**
+ * @brief Sets a timer to notify a task on expiry.
+ *
+ * @note The notification value of the task is or'ed with the bits, so one
+ *       task may wait on several timers with xTaskNotifyWait.
+ * @note Uses the timer context, which must not be changed while the timer is set.
+ *
+ * @param timer     Pointer to timer.
+ * @param reload_ms Timer reload value in ms.
+ * @param repeat    Whether timer should restart after timeout.
+ * @param p_notify  Task and bits to be notified, must be valid while the timer is set.
+ *
+ * @retval SOFT_TIMER_STATUS_SUCCESS           Timer set.
+ * @retval SOFT_TIMER_STATUS_INVALID_PARAMETER NULL notification or rejected by @ref soft_timer_set.
+ * @retval SOFT_TIMER_STATUS_INVALID_STATE     Timer is running.
+ */
+soft_timer_status_t soft_timer_rtos_set_notify(soft_timer_t* timer, uint32_t reload_ms, bool repeat,
+                                               soft_timer_rtos_notify_t* p_notify);
+
+/**
+ * @brief Thread safe @ref soft_timer_start.
+ *
+ * @param timer Pointer to timer.
+ *
+ * @return Same as @ref soft_timer_start.
+ */
+soft_timer_status_t soft_timer_rtos_start(soft_timer_t* timer);
+
+/**
+ * @brief Thread safe @ref soft_timer_stop.
+ *
+ * @param timer Pointer to timer.
+ *
+ * @return Same as @ref soft_timer_stop.
+ */
+soft_timer_status_t soft_timer_rtos_stop(soft_timer_t* timer);
+
+/**
+ * @brief Thread safe @ref soft_timer_restart.
+ *
+ * @param timer Pointer to timer.
+ *
+ * @return Same as @ref soft_timer_restart.
+ */
+soft_timer_status_t soft_timer_rtos_restart(soft_timer_t* timer);
+
+/**
+ * @brief Blocks the calling task for given time, with sub tick resolution.
+ *
+ * @note A timer is taken from the pool for the delay, which notifies the
+ *       task with SOFT_TIMER_RTOS_DELAY_BIT. Other notifications received
+ *       meanwhile are kept pending.
+ *
+ * @param delay_ms Time to wait in milliseconds.
+ *
+ * @retval SOFT_TIMER_STATUS_SUCCESS           Time elapsed.
+ * @retval SOFT_TIMER_STATUS_INVALID_PARAMETER Delay longer than the maximum reload.
+ * @retval SOFT_TIMER_STATUS_INVALID_STATE     No timer available in the pool.
+ */
+soft_timer_status_t soft_timer_rtos_delay_ms(uint32_t delay_ms);
+
+/**
+ * @brief Limits the tickless idle time to the next timer deadline.
+ *
+ * @note To be used in FreeRTOSConfig.h, so the RTOS sleep wakes up for
+ *       timers whose clock stops during sleep:
+ *       #define configPRE_SUPPRESS_TICKS_AND_SLEEP_PROCESSING(x) ((x) = soft_timer_rtos_idle_time_limit(x))
+ * @note Rounded down to RTOS ticks, so the sleep ends before the deadline.
+ *
+ * @param expected_idle_time Idle time expected by the RTOS in RTOS ticks.
+ *
+ * @return Smallest of the expected idle time and the time to the next deadline, in RTOS ticks.
+ */
+TickType_t soft_timer_rtos_idle_time_limit(TickType_t expected_idle_time);
+
+#endif
+
+#endif // __SOFT_TIMER_RTOS_H__
@@ -10,434 +10,3581 @@
 
 #include "soft_timer.h"
 
-#include "tim.h"
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+
+// No HAL nor CMSIS off target
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define UNUSED(x) ((void) (x))
+#define __weak    __attribute__((weak))
+#define __DMB()   __sync_synchronize()
+
+// Simulated interrupts only run from soft_timer_host_advance
+#define __get_PRIMASK()  (0U)
+#define __set_PRIMASK(x) UNUSED(x)
+#define __disable_irq()
+
+#else
+
 #include "utils.h"
 
+#endif
+
 /*****************************************
  * Private Constants
  *****************************************/
 
-#define STOPPED_TIMER_COUNTDOWN_VALUE (0xFFFFFFFF)
 #define PRESCALER_MAX_VALUE (0xFFFF)
+#define DEFAULT_TICK_FREQUENCY_HZ (1000)
+
+/**
+ * @brief Deadlines are compared through signed differences, so timeouts
+ *        must fit in 31 bits to survive time base wrap around.
+ *
+ * @note Not bounded by the hardware counter, deadlines many counter periods
+ *       ahead match the compare value once per period and are rescheduled
+ *       until due.
+ */
+#define MAX_TIMEOUT_TICKS (0x7FFFFFFF)
+
+/**
+ * @brief Hardware timer interrupt events, see @ref hard_timer_events_take.
+ */
+#define HARD_TIMER_EVENT_OVERFLOW (1U << 0)
+#define HARD_TIMER_EVENT_COMPARE  (1U << 1)
+
+#if SOFT_TIMER_PACKED
+
+#define MAX_RELOAD_TICKS (UINT16_MAX)
+#define MAX_SLACK_TICKS  (UINT16_MAX)
+
+#else
+
+#define MAX_RELOAD_TICKS (MAX_TIMEOUT_TICKS)
+#define MAX_SLACK_TICKS  (MAX_TIMEOUT_TICKS)
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_LPTIM
+
+#define LPTIM_COUNTER_MAX (0xFFFF)
+
+/**
+ * @brief Compare register writes take a few LPTIM clock cycles to complete,
+ *        so closer deadlines are delayed to be sure the match is not missed.
+ */
+#define LPTIM_COMPARE_MIN_TICKS (3)
+
+#endif
+
+#define TOTAL_TIMERS (SOFT_TIMER_MAX_TIMERS + SOFT_TIMER_MAX_STATIC_TIMERS)
+
+#if (SOFT_TIMER_MAX_SCHEDULERS < 1) || (SOFT_TIMER_MAX_SCHEDULERS > 255)
+#error SOFT_TIMER_MAX_SCHEDULERS must be between 1 and 255.
+#endif
+
+#if SOFT_TIMER_MAX_TIMERS < 1
+#error SOFT_TIMER_MAX_TIMERS must be at least 1.
+#endif
+
+#if TOTAL_TIMERS > 256
+#error SOFT_TIMER_MAX_TIMERS plus SOFT_TIMER_MAX_STATIC_TIMERS cannot be greater than 256.
+#endif
+
+#if (SOFT_TIMER_BACKEND != SOFT_TIMER_BACKEND_LIST) && (SOFT_TIMER_BACKEND != SOFT_TIMER_BACKEND_WHEEL) && \
+    (SOFT_TIMER_BACKEND != SOFT_TIMER_BACKEND_SCAN)
+#error SOFT_TIMER_BACKEND must be SOFT_TIMER_BACKEND_LIST, SOFT_TIMER_BACKEND_WHEEL or SOFT_TIMER_BACKEND_SCAN.
+#endif
+
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
+
+#if (SOFT_TIMER_WHEEL_LEVELS < 1) || (SOFT_TIMER_WHEEL_LEVELS > 6)
+#error SOFT_TIMER_WHEEL_LEVELS must be between 1 and 6.
+#endif
+
+#define WHEEL_SLOT_BITS     (5)
+#define WHEEL_SLOTS         (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK     (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE_TICKS   (1UL << (WHEEL_SLOT_BITS * SOFT_TIMER_WHEEL_LEVELS))
+#define WHEEL_SLOT_NONE     (0)
+
+#endif
+
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN
+
+#define SCAN_QUEUED_WORDS ((TOTAL_TIMERS + 31) / 32)
+
+#endif
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+
+#define READY_QUEUE_SIZE (TOTAL_TIMERS + 1)
+
+#endif
+
+#if SOFT_TIMER_CONCURRENT_API
+
+#if SOFT_TIMER_HARDWARE != SOFT_TIMER_HARDWARE_TIM
+#error SOFT_TIMER_CONCURRENT_API requires SOFT_TIMER_HARDWARE_TIM, other compare events cannot be generated by software.
+#endif
+
+#define COMMAND_PENDING_WORDS ((TOTAL_TIMERS + 31) / 32)
+
+/**
+ * @brief Flag of a posted period change that moves the current timeout, above the largest period.
+ */
+#define PERIOD_REQUEST_NOW (1UL << 31)
+
+/**
+ * @brief Exception number never read from IPSR.
+ */
+#define IPSR_NONE (0xFFFFFFFF)
+
+#endif
+
+#if (SOFT_TIMER_PRIORITY_LEVELS < 1) || (SOFT_TIMER_PRIORITY_LEVELS > 8)
+#error SOFT_TIMER_PRIORITY_LEVELS must be between 1 and 8.
+#endif
+
+/**
+ * @brief Expired timers are gathered by priority before their callbacks.
+ *
+ * @note Deferred callbacks are ordered by their ready queues instead.
+ */
+#define EXPIRED_LISTS ((SOFT_TIMER_PRIORITY_LEVELS > 1) && !SOFT_TIMER_DEFERRED_CALLBACKS)
+
+#if SOFT_TIMER_STATS && (SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST)
+#error SOFT_TIMER_STATS requires the DWT cycle counter, not available on host.
+#endif
+
+#if SOFT_TIMER_STATS && (__CORTEX_M < 3U)
+#error SOFT_TIMER_STATS requires the DWT cycle counter, not available on Cortex-M0/M0+.
+#endif
 
-#if SOFT_TIMER_MAX_TIMERS > 256
-#error SOFT_TIMER_MAX_INSTANCES cannot be greater than 256.
+#if SOFT_TIMER_TRACE && ((SOFT_TIMER_TRACE_SIZE & (SOFT_TIMER_TRACE_SIZE - 1)) != 0)
+#error SOFT_TIMER_TRACE_SIZE must be a power of two.
 #endif
 
 /*****************************************
  * Private Macros
  *****************************************/
 
-#define HZ_TO_KHZ(f) ((f) / 1e3)
-#define HZ_TO_MHZ(f) ((f) / 1e6)
+/**
+ * @brief Checks if a timer id belongs to a timer in user memory.
+ */
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+#define TIMER_ID_IS_STATIC(id) ((id) >= SOFT_TIMER_MAX_TIMERS)
+#else
+#define TIMER_ID_IS_STATIC(id) (false)
+#endif
+
+#define MS_PER_S (1000)
+#define US_PER_S (1000000)
+#define NS_PER_S (1000000000)
+#define PPM      (1000000)
+
+/**
+ * @brief Converts a frequency to ticks per time unit in Q32.32 fixed point.
+ */
+#define TICKS_PER_UNIT_Q32(f, units_per_s) (((((uint64_t) (f)) << 32) + ((units_per_s) / 2)) / (units_per_s))
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_TIM
+
+/**
+ * @brief Interrupt, flag and event bits of the compare channel in use.
+ */
+#define TIMER_CHANNEL_INDEX     (SOFT_TIMER_TIM_CHANNEL >> 2U)
+#define TIMER_IT_CC             (TIM_IT_CC1 << TIMER_CHANNEL_INDEX)
+#define TIMER_FLAG_CC           (TIM_FLAG_CC1 << TIMER_CHANNEL_INDEX)
+#define TIMER_EVENTSOURCE_CC    (TIM_EVENTSOURCE_CC1 << TIMER_CHANNEL_INDEX)
+
+#endif
 
 /*****************************************
  * Private Functions Prototypes
  *****************************************/
 
 /**
- * @brief Stops given software timer.
+ * @brief Checks if given pointer is a created or free timer instance.
  *
- *  @param timer Pointer to software timer to be stopped.
+ * @param timer Pointer to be checked.
+ *
+ * @return true if pointer belongs to the timer pool or to a static timer,
+ *         false otherwise.
  */
-static void timer_stop(soft_timer_t* timer);
+static bool timer_is_valid(soft_timer_t* timer);
 
 /**
- * @brief Update given software timer with given amount of time.
+ * @brief Checks if given timers are valid and share one scheduler.
  *
- * @note Expired timers callbacks are called.
+ * @param p_timers Array of pointers to timers.
+ * @param count    Number of timers in the array.
  *
- * @param timer        Pointer to timer to be updated.
- * @param time_step_ms Amount of time to be updated (milliseconds)
+ * @return true if group is not empty and all timers are valid and belong
+ *         to the same scheduler, false otherwise.
  */
-static void timer_step(soft_timer_t* timer, uint16_t time_step_ms);
+static bool group_is_valid(soft_timer_t* const* p_timers, uint16_t count);
 
 /**
- * @brief Update software timers and configure timer handler accordingly.
+ * @brief Checks if all timers of a group are in given state.
+ *
+ * @param p_timers Array of pointers to timers.
+ * @param count    Number of timers in the array.
+ * @param state    Expected timer state.
  *
- * @param time_since_last_update_ms Time since software timers were last
- *                                  updated (in milliseconds).
+ * @return true if all timers are in given state, false otherwise.
  */
-static void timers_update(uint32_t time_since_last_update_ms);
+static bool group_state_is(soft_timer_t* const* p_timers, uint16_t count, uint8_t state);
 
 /**
- * @brief Update software timers.
- *
- * @note Expired timers callbacks are called.
+ * @brief Waits for an event flag or a timeout, with a timer of given scheduler.
  *
- * @param time_since_last_update_ms Time since last hardware update was
- *                                  performed (in milliseconds).
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_event     Flag set when the event happens, NULL to only wait for the timeout.
+ * @param timeout_ms  Maximum time to wait in milliseconds.
  *
- * @return Time until next software timer expires (in milliseconds).
+ * @return Operation status, SOFT_TIMER_STATUS_TIMEOUT if the time elapsed.
  */
-static uint32_t soft_timers_update(uint32_t time_since_last_update_ms);
+static soft_timer_status_t scheduler_wait(soft_timer_scheduler_t* p_scheduler, volatile bool* p_event,
+                                          uint32_t timeout_ms);
 
 /**
- * @brief Initializes the timer.
+ * @brief Sleeps until given timer is idle or an event flag is set.
+ *
+ * @param timer   Pointer to timer.
+ * @param p_event Flag set when the event happens, may be NULL.
  *
- * @note This functions assumes APBx timer clock is the same as
- *       HCLK to calculate prescaler.
+ * @return true if the event flag is set, false otherwise.
+ */
+static bool timer_wait(soft_timer_t* timer, volatile bool* p_event);
+
+/**
+ * @brief Checks if a timer is stopped, with no command waiting to be applied.
  *
- * @note Timer is configured to 1 millisecond resolution.
+ * @param timer Pointer to timer.
  *
- * @param htim Pointer to timer handler to be initilized.
+ * @return true if timer is idle, false otherwise.
  */
-static void hard_timer_init(TIM_HandleTypeDef* htim);
+static bool timer_is_idle(soft_timer_t* timer);
 
 /**
- * @brief Starts the timer.
+ * @brief Initializes given scheduler instance.
+ *
+ * @note Has no effect on a scheduler already initialized.
  *
- * @param htim Pointer to timer to be started.
+ * @param p_scheduler       Pointer to scheduler to be initialized.
+ * @param htim              Pointer to HAL Timer handler.
+ * @param max_reload_ms     Hardware timer counter max value.
+ * @param tick_frequency_hz Requested timer tick frequency.
  */
-static void hard_timer_start(TIM_HandleTypeDef* htim);
+static void scheduler_init(soft_timer_scheduler_t* p_scheduler, soft_timer_handle_t* htim, uint32_t max_reload_ms,
+                           uint32_t tick_frequency_hz);
 
 /**
- * @brief Stops the timer.
+ * @brief Stops given software timer.
  *
- * @param htim Pointer to timer to be stopped.
+ *  @param timer Pointer to software timer to be stopped.
  */
-static void hard_timer_stop(TIM_HandleTypeDef* htim);
+static void timer_stop(soft_timer_t* timer);
 
 /**
- * @brief Gets timer counter value.
+ * @brief Configures given software timer.
  *
- * @param htim Pointer to timer.
+ * @param timer        Pointer to timer instance to be configured.
+ * @param callback     Pointer to timeout callback function.
+ * @param reload_ticks Value to reload timer in timer ticks (min 1).
+ * @param repeat       Boolean flag signalling if timer should repeat after timeout.
+ * @param slack_ticks  Maximum timeout delay in timer ticks.
  *
- * @return Timer counter value in milliseconds.
+ * @return Operation status.
  */
-static uint32_t hard_timer_counter_get(TIM_HandleTypeDef* htim);
+static soft_timer_status_t timer_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ticks,
+                                     bool repeat, uint32_t slack_ticks);
 
 /**
- * @brief Sets timer reload value.
+ * @brief Changes the reload value of given timer, see @ref soft_timer_set_period.
  *
- * @param htim      Pointer to timer.
- * @param reload_ms Timer reload value in milliseconds.
- *                  Caps at hard_timer_MAX_RELOAD_MS
+ * @param timer        Pointer to timer instance.
+ * @param period_ticks New reload value in timer ticks.
+ * @param immediate    Whether the current timeout is moved to the new period.
+ *
+ * @return Operation status.
  */
-static void hard_timer_reload_set(TIM_HandleTypeDef* htim, uint32_t reload_ms);
+static soft_timer_status_t timer_period_set(soft_timer_t* timer, uint32_t period_ticks, bool immediate);
 
 /**
- * @brief Gets timer reload value.
+ * @brief Applies a new reload value, requeueing the timer if immediate.
+ *
+ * @note Does not program the hardware timer.
  *
- * @param htim Pointer to timer.
+ * @param timer        Pointer to timer instance.
+ * @param period_ticks New reload value in timer ticks.
+ * @param immediate    Whether the current timeout is moved to the new period.
+ */
+static void timer_period_apply(soft_timer_t* timer, uint32_t period_ticks, bool immediate);
+
+/**
+ * @brief Queues given software timer to expire at its due time plus slack.
  *
- * @return Timer reload value in milliseconds.
+ * @param timer Pointer to timer to be queued.
+ * @param due   Nominal absolute timeout time (timer ticks).
  */
-static uint32_t hard_timer_reload_get(TIM_HandleTypeDef* htim);
+static void timer_queue(soft_timer_t* timer, uint32_t due);
 
 /**
- * @brief Update timer handler..
+ * @brief Applies slack to a timeout time.
+ *
+ * @note Picks the time in the window [due, due + slack_ticks] with most
+ *       trailing zero bits, as timers with close windows pick the same one.
  *
- * @note Stops timer if reload is 0.
+ * @param due         Nominal absolute timeout time (timer ticks).
+ * @param slack_ticks Maximum timeout delay in timer ticks.
  *
- * @param timer_reload_ms Reload value to be configured in handler (in milliseconds).
+ * @return Absolute timeout time (timer ticks).
  */
-static void hard_timer_update(uint32_t timer_reload_ms);
+static uint32_t slack_apply(uint32_t due, uint32_t slack_ticks);
 
 /**
- * @brief Adjust the prescaler value to fit 0xFFFF limit.
+ * @brief Converts time to timer ticks.
  *
- * @param hclk_frequency hardware clock frequency to be devided by the prescaler
- * @param prescaler pointer to prescaler value
+ * @note Only integer multiplications are used, rounding to the nearest tick.
+ *
+ * @param time               Time in any unit.
+ * @param ticks_per_unit_q32 Timer ticks per time unit in Q32.32 fixed point.
+ *
+ * @return Time in timer ticks, saturated at 0xFFFFFFFF.
  */
-static void presc_adjust(uint32_t hclk_frequency, uint32_t* prescaler);
+static uint32_t time_to_ticks(uint32_t time, uint64_t ticks_per_unit_q32);
 
-/*****************************************
- * Private Types
- *****************************************/
+/**
+ * @brief Handles the timeout of given software timer.
+ *
+ * @note Timer is removed from the expiry queue, its callback is called and
+ *       it is either queued again (repeating timers) or stopped. With
+ *       priority levels, the callback is left to @ref expired_dispatch.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void timer_expire(soft_timer_t* timer);
 
 /**
- * @brief Possible timer states.
+ * @brief Calls the callback of an expired timer and queues it again or stops it.
+ *
+ * @param timer Pointer to expired timer, already removed from the expiry queue.
  */
-typedef enum timer_state {
-    TIMER_STATE_FREE = 0, /**< Unallocated timer. */
-    TIMER_STATE_STOPPED,  /**< Allocated timer that is not running. */
-    TIMER_STATE_RUNNING,  /**< Allocated timer that is running. */
-} timer_state_t;
+static void timer_timeout(soft_timer_t* timer);
 
 /**
- * @brief Type definition for software timer instance.
+ * @brief Drops the periods an expired repeating timer has already missed.
+ *
+ * @note Nominal timeout is moved to the last elapsed period, so the next one
+ *       is ahead of current time. Done before the callback, so dropped
+ *       periods are already reported to it.
+ *
+ * @param timer Pointer to expired timer.
  */
-struct soft_timer {
-    timer_state_t         state;        /**< Current timer state. */
-    uint8_t               id;           /**< Sequential timer id */
-    uint32_t              reload_ms;    /**< Configured reload value. */
-    uint32_t              countdown_ms; /**< Remaining time until timeout. */
-    bool                  repeat;       /**< Repeat setting. */
-    soft_timer_callback_t callback;     /**< Timeout callback. */
-};
+static void timer_missed_periods_skip(soft_timer_t* timer);
 
-/*****************************************
- * Private Variables
- *****************************************/
+#if EXPIRED_LISTS
 
 /**
- * @brief Array of available software timer instances.
+ * @brief Calls callbacks of gathered expired timers, highest priority first.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return true if any timer was gathered, false otherwise.
  */
-static soft_timer_t m_timers[SOFT_TIMER_MAX_TIMERS];
+static bool expired_dispatch(soft_timer_scheduler_t* p_scheduler);
+
+#endif
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
 
 /**
- * @brief Timer handler instance.
+ * @brief Calls callbacks of one ready queue of given scheduler.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param priority    Priority level of the ready queue.
  */
-static TIM_HandleTypeDef* mp_htim;
+static void ready_queue_dispatch(soft_timer_scheduler_t* p_scheduler, uint8_t priority);
+
+#endif
 
 /**
- * @brief Flags if this module has already been initialized.
+ * @brief Inserts given software timer in the expiry queue.
  *
- * @note Avoids multiple initializations that would reset running timers.
+ * @param timer    Pointer to timer to be inserted.
+ * @param deadline Absolute timeout time (timer ticks).
  */
-static bool m_is_initialized = false;
+static void queue_insert(soft_timer_t* timer, uint32_t deadline);
 
 /**
- * @brief Physical timer max reload value
+ * @brief Removes given software timer from the expiry queue.
  *
- * @note Usually 16-bit (0xFFFF) or 32-bit (0xFFFFF), this is capped at
- *       0xFFFFFFFF - 1, because 0xFFFFFFF is reserved for stopped timers.
+ * @note Does nothing if the timer is not queued.
+ *
+ * @param timer Pointer to timer to be removed.
  */
-static uint32_t m_max_reload_ms = 0xFFFF;
+static void queue_remove(soft_timer_t* timer);
 
 /**
- * @brief Multiply each timer's reload
+ * @brief Checks if given software timer is in the expiry queue.
+ *
+ * @param timer Pointer to timer.
  *
- * @note Used to avoid prescaler erros due to timers that require values
- *       greater than 0xFFFF.
+ * @return true if timer is queued, false otherwise.
  */
-static float m_reload_adjust = 1.0;
+static bool queue_contains(soft_timer_t* timer);
 
-/*****************************************
- * Public Functions Bodies Definitions
- *****************************************/
+/**
+ * @brief Gets the time at which the expiry queue must be updated next.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_deadline  Pointer to store absolute time of next update (timer ticks).
+ *
+ * @return true if there is a running timer, false otherwise.
+ */
+static bool queue_next_deadline(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline);
 
-void soft_timer_init(TIM_HandleTypeDef* htim, uint32_t max_reload_ms) {
-    mp_htim = htim;
-    m_max_reload_ms = min(max_reload_ms, 0xFFFFFFFF - 1);
+/**
+ * @brief Calls timeout callback of given software timer.
+ *
+ * @note In deferred callbacks mode the timer is only added to the ready
+ *       queue to be dispatched later.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void timer_callback_call(soft_timer_t* timer);
 
-    if (m_is_initialized) {
-        return;
-    }
+/**
+ * @brief Starts given software timer.
+ *
+ * @param timer      Pointer to timer to be started.
+ * @param start_time Absolute time from which reload is counted (timer ticks).
+ */
+static void timer_start(soft_timer_t* timer, uint32_t start_time);
 
-    for (uint8_t i = 0; i < SOFT_TIMER_MAX_TIMERS; i++) {
-        timer_stop(&m_timers[i]);
-        m_timers[i].state = TIMER_STATE_FREE;
-        m_timers[i].id = i;
-    }
+/**
+ * @brief Restarts countdown of given software timer.
+ *
+ * @note Timer is started if stopped.
+ *
+ * @param timer      Pointer to timer to be restarted.
+ * @param start_time Absolute time from which reload is counted (timer ticks).
+ */
+static void timer_restart(soft_timer_t* timer, uint32_t start_time);
 
-    hard_timer_init(mp_htim);
+/**
+ * @brief Restarts given software timer from now and reschedules if needed.
+ *
+ * @note Configured compare is kept if the next deadline does not change.
+ *
+ * @param timer Pointer to timer to be restarted.
+ */
+static void timer_restart_now(soft_timer_t* timer);
 
-    m_is_initialized = true;
-}
+/**
+ * @brief Starts given software timer with its first timeout at an absolute time.
+ *
+ * @param timer    Pointer to timer to be started.
+ * @param deadline Nominal absolute time of first timeout.
+ *
+ * @return Operation status.
+ */
+static soft_timer_status_t timer_start_deadline(soft_timer_t* timer, uint32_t deadline);
 
-soft_timer_t* soft_timer_create(void) {
-    for (uint8_t i = 0; i < SOFT_TIMER_MAX_TIMERS; i++) {
-        if (m_timers[i].state == TIMER_STATE_FREE) {
-            m_timers[i].state = TIMER_STATE_STOPPED;
-            return &m_timers[i];
-        }
-    }
+/**
+ * @brief Update software timers and configure timer handler accordingly.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+static void timers_update(soft_timer_scheduler_t* p_scheduler);
 
-    return NULL;
-}
+/**
+ * @brief Requests software timers to be updated.
+ *
+ * @note With SOFT_TIMER_CONCURRENT_API the update is left to the compare
+ *       interrupt, otherwise it is done right away.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+static void timers_update_request(soft_timer_scheduler_t* p_scheduler);
 
-void soft_timer_destroy(soft_timer_t** timer) {
-    soft_timer_t* first_timer = &(m_timers[0]);
-    soft_timer_t* last_timer = &(m_timers[SOFT_TIMER_MAX_TIMERS]);
+/**
+ * @brief Configure timer handler for the next software timer timeout.
+ *
+ * @note Compare interrupt is disabled if no timer is running.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+static void timers_schedule(soft_timer_scheduler_t* p_scheduler);
 
-    if ((*timer >= first_timer) && (*timer < last_timer) && ((*timer)->state == TIMER_STATE_STOPPED)) {
-        (*timer)->state = TIMER_STATE_FREE;
-        *timer = NULL;
-    }
-}
+#if SOFT_TIMER_CONCURRENT_API || (SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN)
 
-soft_timer_status_t soft_timer_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
-                                   bool repeat) {
-    soft_timer_t* first_timer = &(m_timers[0]);
-    soft_timer_t* last_timer = &(m_timers[SOFT_TIMER_MAX_TIMERS]);
+/**
+ * @brief Gets timer instance from its id.
+ *
+ * @param p_scheduler Pointer to scheduler owning the timer.
+ * @param id          Timer id.
+ *
+ * @return Pointer to timer.
+ * @retval NULL Returns null if no static timer has given id.
+ */
+static soft_timer_t* timer_from_id(soft_timer_scheduler_t* p_scheduler, uint8_t id);
 
-    if (!((timer >= first_timer) && (timer < last_timer))) {
-        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
-    }
+#endif
 
-    if ((reload_ms <= 1) || (reload_ms > m_max_reload_ms)) {
-        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
-    }
+#if SOFT_TIMER_CONCURRENT_API
 
-    if (timer->state != TIMER_STATE_STOPPED) {
-        return SOFT_TIMER_STATUS_INVALID_STATE;
-    }
+/**
+ * @brief Checks if running in the timer compare interrupt.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return true if in the timer compare interrupt, false otherwise.
+ */
+static bool timer_isr_context(soft_timer_scheduler_t* p_scheduler);
 
-    timer->reload_ms = reload_ms;
-    timer->repeat = repeat;
-    timer->callback = callback;
+/**
+ * @brief Posts a command to be applied by the timer compare interrupt.
+ *
+ * @note Only the last command posted for a timer before the interrupt
+ *       runs is applied.
+ *
+ * @param timer   Pointer to target timer.
+ * @param command Command to be applied.
+ */
+static void command_post(soft_timer_t* timer, uint8_t command);
 
-    return SOFT_TIMER_STATUS_SUCCESS;
-}
+/**
+ * @brief Writes a command without requesting the timer compare interrupt.
+ *
+ * @param timer   Pointer to target timer.
+ * @param command Command to be applied.
+ * @param time    Time at which command was posted.
+ */
+static void command_write(soft_timer_t* timer, uint8_t command, uint32_t time);
 
-soft_timer_status_t soft_timer_start(soft_timer_t* timer) {
-    soft_timer_t* first_timer = &(m_timers[0]);
-    soft_timer_t* last_timer = &(m_timers[SOFT_TIMER_MAX_TIMERS]);
+/**
+ * @brief Writes a period change without requesting the timer compare interrupt.
+ *
+ * @note Period changes have their own mailbox, so they neither replace nor
+ *       are replaced by a command posted before the interrupt runs.
+ *
+ * @param timer        Pointer to target timer.
+ * @param period_ticks New reload value in timer ticks.
+ * @param immediate    Whether the current timeout is moved to the new period.
+ */
+static void period_request_write(soft_timer_t* timer, uint32_t period_ticks, bool immediate);
 
-    if (!((timer >= first_timer) && (timer < last_timer))) {
-        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
-    }
+/**
+ * @brief Atomically sets the pending flag of given timer.
+ *
+ * @param p_flags Pending flags, one bit per timer id.
+ * @param timer   Pointer to timer.
+ */
+static void command_pending_set(volatile uint32_t* p_flags, soft_timer_t* timer);
 
-    if (timer->state != TIMER_STATE_STOPPED) {
-        return SOFT_TIMER_STATUS_INVALID_STATE;
-    }
+/**
+ * @brief Atomically reads and clears a word of pending flags.
+ *
+ * @param p_flags Pending flags, one bit per timer id.
+ * @param word    Pending flags word index.
+ *
+ * @return Flags set before clearing.
+ */
+static uint32_t command_pending_take(volatile uint32_t* p_flags, uint8_t word);
 
-    uint32_t time_since_last_update_ms = hard_timer_counter_get(mp_htim);
+/**
+ * @brief Applies all commands and period changes posted since last call.
+ *
+ * @note Must only be called from the timer compare interrupt.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ */
+static void commands_apply(soft_timer_scheduler_t* p_scheduler);
 
-    timers_update(time_since_last_update_ms);
+/**
+ * @brief Applies the last command posted for a timer.
+ *
+ * @param timer Pointer to timer.
+ */
+static void command_apply(soft_timer_t* timer);
 
-    timer->countdown_ms = timer->reload_ms - 1;
-    timer->state = TIMER_STATE_RUNNING;
+#endif
 
-    timers_update(0);
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
 
-    return SOFT_TIMER_STATUS_SUCCESS;
-}
+/**
+ * @brief Places given software timer in the wheel slot matching its deadline.
+ *
+ * @param timer Pointer to timer to be placed.
+ */
+static void wheel_place(soft_timer_t* timer);
 
-soft_timer_status_t soft_timer_stop(soft_timer_t* timer) {
-    soft_timer_t* first_timer = &(m_timers[0]);
-    soft_timer_t* last_timer = &(m_timers[SOFT_TIMER_MAX_TIMERS]);
+/**
+ * @brief Moves timers of given wheel slot to the lower levels.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param level       Wheel level of the slot.
+ * @param index       Slot index inside the level.
+ */
+static void wheel_cascade(soft_timer_scheduler_t* p_scheduler, uint8_t level, uint8_t index);
 
-    if (!((timer >= first_timer) && (timer < last_timer))) {
+/**
+ * @brief Checks if there are timers in the wheel.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return true if no timer is queued, false otherwise.
+ */
+static bool wheel_is_empty(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Gets time of the next wheel event, either a timeout or a cascade.
+ *
+ * @note Wheel must not be empty.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ *
+ * @return Absolute time of the next event (timer ticks).
+ */
+static uint32_t wheel_next_event(soft_timer_scheduler_t* p_scheduler);
+
+#elif SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN
+
+/**
+ * @brief Scans queued timers for the earliest deadline.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_deadline  Pointer to store earliest absolute timeout time (timer ticks).
+ *
+ * @return true if there is a queued timer, false otherwise.
+ */
+static bool scan_earliest(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline);
+
+/**
+ * @brief Gets the earliest deadline without writing the earliest deadline cache.
+ *
+ * @note Safe from thread context while the timer interrupt updates the cache.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param p_deadline  Pointer to store earliest absolute timeout time (timer ticks).
+ *
+ * @return true if there is a queued timer, false otherwise.
+ */
+static bool scan_next_deadline_peek(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline);
+
+#endif
+
+/**
+ * @brief Update software timers.
+ *
+ * @note Expired timers callbacks are called. Only expired timers and the
+ *       first timer still running are touched.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param now         Current absolute time (timer ticks).
+ */
+static void soft_timers_update(soft_timer_scheduler_t* p_scheduler, uint32_t now);
+
+#if SOFT_TIMER_STATS
+
+/**
+ * @brief Records statistics of a timer expiration.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void stats_expiry_record(soft_timer_t* timer);
+
+/**
+ * @brief Records statistics of a timer callback call.
+ *
+ * @param timer  Pointer to timer.
+ * @param cycles Cycles spent in the callback.
+ */
+static void stats_callback_record(soft_timer_t* timer, uint32_t cycles);
+
+/**
+ * @brief Records statistics of a compare interrupt.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param cycles      Cycles spent in the interrupt.
+ */
+static void stats_isr_record(soft_timer_scheduler_t* p_scheduler, uint32_t cycles);
+
+#endif
+
+#if SOFT_TIMER_TRACE
+
+/**
+ * @brief Appends an event to the trace buffer.
+ *
+ * @note Slots are reserved atomically and the type is written last, so the
+ *       reader skips slots of writers that were interrupted.
+ *
+ * @param p_scheduler Pointer to scheduler.
+ * @param type        Event type, a soft_timer_trace_type_t.
+ * @param timer_id    Timer id, 0 if not related to a timer.
+ * @param value       Event value.
+ */
+static void trace_record(soft_timer_scheduler_t* p_scheduler, uint8_t type, uint8_t timer_id, uint32_t value);
+
+#endif
+
+/**
+ * @brief Initializes the timer.
+ *
+ * @note Sets the tick frequency, the input clock and divider giving it exactly,
+ *       and its error from the requested frequency.
+ *
+ * @note Timer is left free running, wrapping at its maximum counter value.
+ *
+ * @param p_scheduler       Pointer to scheduler of the timer to be initilized.
+ * @param tick_frequency_hz Requested timer tick frequency.
+ */
+static void hard_timer_init(soft_timer_scheduler_t* p_scheduler, uint32_t tick_frequency_hz);
+
+/**
+ * @brief Gets current absolute time.
+ *
+ * @note Counter overflows not yet handled by the interrupt are accounted.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ *
+ * @return Time since initialization (timer ticks).
+ */
+static uint32_t hard_timer_now(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Gets timer counter value.
+ *
+ * @note Counter value is zero right after an overflow is flagged.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ *
+ * @return Timer counter value (timer ticks).
+ */
+static uint32_t hard_timer_counter_get(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Checks if there is a counter overflow flagged.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ *
+ * @return true if an overflow interrupt is pending, false otherwise.
+ */
+static bool hard_timer_overflow_pending(soft_timer_scheduler_t* p_scheduler);
+
+/**
+ * @brief Programs the compare channel to interrupt at given time.
+ *
+ * @note If the deadline has already been reached, the compare event is
+ *       generated as soon as possible so it is not missed.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ * @param deadline    Absolute interrupt time (timer ticks).
+ */
+static void hard_timer_compare_set(soft_timer_scheduler_t* p_scheduler, uint32_t deadline);
+
+/**
+ * @brief Disables the compare channel interrupt.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ */
+static void hard_timer_compare_stop(soft_timer_scheduler_t* p_scheduler);
+
+#if SOFT_TIMER_HARDWARE != SOFT_TIMER_HARDWARE_HOST
+
+/**
+ * @brief Reads and clears the enabled overflow and compare interrupt flags.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ *
+ * @return Taken events, HARD_TIMER_EVENT_OVERFLOW and HARD_TIMER_EVENT_COMPARE bits.
+ */
+static uint32_t hard_timer_events_take(soft_timer_scheduler_t* p_scheduler);
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+
+/**
+ * @brief Runs pending interrupts of a simulated timer.
+ *
+ * @note Compare is handled before overflow, as in the HAL interrupt handler.
+ *
+ * @param p_scheduler Pointer to scheduler of the timer.
+ */
+static void host_interrupts_run(soft_timer_scheduler_t* p_scheduler);
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_TIM
+
+/**
+ * @brief Gets the input clock frequency of a TIM.
+ *
+ * @note The APB bus of the TIM is found by its address. Timers of a bus with
+ *       a prescaler other than 1 are clocked at twice the bus frequency.
+ *
+ * @param htim Pointer to HAL Timer handler.
+ *
+ * @return Timer clock frequency in Hz.
+ */
+static uint32_t hard_timer_clock_get(soft_timer_handle_t* htim);
+
+/**
+ * @brief Checks if given TIM channel may be used by a hardware trigger.
+ *
+ * @param channel TIM channel.
+ *
+ * @return True if channel is one of the four compare channels or TIM_CHANNEL_ALL.
+ */
+static bool trigger_channel_is_valid(uint32_t channel);
+
+/**
+ * @brief Converts a period in scheduler ticks to cycles of a trigger TIM clock.
+ *
+ * @param p_scheduler  Pointer to scheduler giving the tick.
+ * @param htim_trigger Pointer to HAL Timer handler of the trigger.
+ * @param period_ticks Period in timer ticks.
+ *
+ * @return Period in trigger TIM clock cycles, rounded to nearest.
+ */
+static uint64_t trigger_cycles_get(soft_timer_scheduler_t* p_scheduler, soft_timer_handle_t* htim_trigger,
+                                   uint32_t period_ticks);
+
+#endif
+
+/*****************************************
+ * Private Types
+ *****************************************/
+
+/**
+ * @brief Possible timer states.
+ */
+typedef enum timer_state {
+    TIMER_STATE_FREE = 0, /**< Unallocated timer. */
+    TIMER_STATE_STOPPED,  /**< Allocated timer that is not running. */
+    TIMER_STATE_RUNNING,  /**< Allocated timer that is running. */
+} timer_state_t;
+
+#if SOFT_TIMER_CONCURRENT_API
+
+/**
+ * @brief Commands posted from outside the timer interrupt.
+ */
+typedef enum timer_command {
+    TIMER_COMMAND_START = 0,  /**< Start timer if stopped. */
+    TIMER_COMMAND_STOP,       /**< Stop timer if running. */
+    TIMER_COMMAND_RESTART,    /**< Restart timer countdown, starting it if stopped. */
+    TIMER_COMMAND_RESET,      /**< Restart timer countdown if running. */
+} timer_command_t;
+
+#endif
+
+/**
+ * @brief Type definition for software timer instance.
+ */
+struct soft_timer {
+#if SOFT_TIMER_BACKEND != SOFT_TIMER_BACKEND_SCAN
+    uint32_t                deadline;     /**< Absolute timeout time. */
+#endif
+    uint32_t                due;          /**< Nominal absolute timeout time, without slack. */
+#if SOFT_TIMER_PACKED
+    uint16_t                reload_ticks; /**< Configured reload value. */
+    uint16_t                slack_ticks;  /**< Maximum timeout delay. */
+#else
+    uint32_t                reload_ticks; /**< Configured reload value. */
+    uint32_t                slack_ticks;  /**< Maximum timeout delay. */
+#endif
+    uint8_t                 id;           /**< Sequential timer id */
+#if SOFT_TIMER_PACKED
+    uint8_t                 state : 2;    /**< Current timer state, a timer_state_t. */
+    uint8_t                 repeat : 1;   /**< Repeat setting. */
+    uint8_t                 catch_up : 2; /**< Missed periods policy, a soft_timer_catch_up_t. */
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    uint8_t                 priority : 3; /**< Callback priority level. */
+#endif
+#else
+    uint8_t                 state;        /**< Current timer state, a timer_state_t. */
+    bool                    repeat;       /**< Repeat setting. */
+    uint8_t                 catch_up;     /**< Missed periods policy, a soft_timer_catch_up_t. */
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    uint8_t                 priority;     /**< Callback priority level. */
+#endif
+#endif
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
+    uint8_t                 slot;         /**< Wheel slot plus one, 0 if not queued. */
+#endif
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+    volatile bool           ready;        /**< Callback waiting in ready queue. */
+#endif
+#if SOFT_TIMER_CONCURRENT_API
+    volatile uint8_t        command;      /**< Last posted command. */
+    volatile bool           period_late;  /**< Period change posted after a pending command. */
+    volatile uint32_t       command_time; /**< Time at which last command was posted. */
+    volatile uint32_t       new_period;   /**< Last posted period change, or'ed with PERIOD_REQUEST_NOW. */
+#endif
+    uint32_t                overruns;     /**< Dropped periods, written by timer interrupt only. */
+    uint32_t                overruns_ack; /**< Dropped periods already reported. */
+    soft_timer_callback_t   callback;     /**< Timeout callback. */
+    void*                   p_context;    /**< User context. */
+#if SOFT_TIMER_STATS
+    uint32_t                cycles_max;   /**< Max cycles spent in callback. */
+#endif
+    soft_timer_t*           p_prev;       /**< Previous timer in expiry queue. */
+    soft_timer_t*           p_next;       /**< Next timer in expiry queue. */
+#if EXPIRED_LISTS
+    soft_timer_t*           p_expired;    /**< Next expired timer of the same priority. */
+#endif
+    soft_timer_scheduler_t* p_scheduler;  /**< Scheduler owning the timer. */
+};
+
+/**
+ * @brief Fails compilation if a timer instance does not fit user storage.
+ */
+typedef char soft_timer_storage_size_check[(sizeof(soft_timer_t) <= sizeof(soft_timer_storage_t)) ? 1 : -1];
+
+/**
+ * @brief Type definition for scheduler instance.
+ *
+ * @note Holds everything bound to one hardware timer, so each scheduler
+ *       runs on its own interrupt.
+ */
+struct soft_timer_scheduler {
+    /**
+     * @brief Array of available software timer instances.
+     */
+    soft_timer_t timers[SOFT_TIMER_MAX_TIMERS];
+
+    /**
+     * @brief Free timers of the pool, linked by their p_next pointer.
+     */
+    soft_timer_t* p_free_timers;
+
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+
+    /**
+     * @brief Timers in user memory, indexed by id minus pool size.
+     */
+    soft_timer_t* p_static_timers[SOFT_TIMER_MAX_STATIC_TIMERS];
+
+    /**
+     * @brief Stack of static timer ids not in use.
+     */
+    uint8_t static_free_ids[SOFT_TIMER_MAX_STATIC_TIMERS];
+
+    /**
+     * @brief Number of static timer ids not in use.
+     */
+    uint8_t static_free_count;
+
+#endif
+
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
+
+    /**
+     * @brief Running timers lists, one per wheel slot.
+     */
+    soft_timer_t* p_wheel_slots[SOFT_TIMER_WHEEL_LEVELS][WHEEL_SLOTS];
+
+    /**
+     * @brief Bitmap of non-empty slots for each wheel level.
+     */
+    uint32_t wheel_pending[SOFT_TIMER_WHEEL_LEVELS];
+
+    /**
+     * @brief Time up to which wheel events have been processed.
+     */
+    uint32_t wheel_time;
+
+#elif SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN
+
+    /**
+     * @brief Absolute timeout time of each timer, indexed by timer id.
+     *
+     * @note Kept apart from the timer instances, so the scan goes through
+     *       contiguous memory.
+     */
+    uint32_t scan_deadlines[TOTAL_TIMERS];
+
+    /**
+     * @brief Flags of queued timers, one bit per timer id.
+     */
+    uint32_t scan_queued[SCAN_QUEUED_WORDS];
+
+    /**
+     * @brief Earliest deadline of the queued timers.
+     */
+    uint32_t scan_next_deadline;
+
+    /**
+     * @brief Flags if there is a queued timer, valid if not stale.
+     */
+    bool scan_next_valid;
+
+    /**
+     * @brief Flags if earliest deadline must be scanned again.
+     */
+    bool scan_next_stale;
+
+#else
+
+    /**
+     * @brief Running timers sorted by deadline, first to expire at the head.
+     */
+    soft_timer_t* p_queue_head;
+
+#endif
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+
+    /**
+     * @brief Expired timers waiting for their callbacks to be dispatched.
+     *
+     * @note Written only by the timer interrupt and read only by
+     *       @ref soft_timer_dispatch, each timer is queued at most once.
+     */
+    soft_timer_t* volatile p_ready_queue[SOFT_TIMER_PRIORITY_LEVELS][READY_QUEUE_SIZE];
+
+    /**
+     * @brief Ready queue write indexes, owned by the timer interrupt.
+     */
+    volatile uint16_t ready_queue_head[SOFT_TIMER_PRIORITY_LEVELS];
+
+    /**
+     * @brief Ready queue read indexes, owned by the dispatchers.
+     */
+    volatile uint16_t ready_queue_tail[SOFT_TIMER_PRIORITY_LEVELS];
+
+#endif
+
+#if EXPIRED_LISTS
+
+    /**
+     * @brief First expired timer of each priority, waiting for its callback.
+     */
+    soft_timer_t* p_expired_head[SOFT_TIMER_PRIORITY_LEVELS];
+
+    /**
+     * @brief Last expired timer of each priority, so timeouts keep their order.
+     */
+    soft_timer_t* p_expired_tail[SOFT_TIMER_PRIORITY_LEVELS];
+
+#endif
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    /**
+     * @brief Flags of timers with a posted command, one bit per timer id.
+     */
+    volatile uint32_t command_pending[COMMAND_PENDING_WORDS];
+
+    /**
+     * @brief Flags of timers with a posted period change, one bit per timer id.
+     */
+    volatile uint32_t period_pending[COMMAND_PENDING_WORDS];
+
+    /**
+     * @brief Exception number of the timer compare interrupt.
+     */
+    volatile uint32_t update_ipsr;
+
+#endif
+
+    /**
+     * @brief Timer handler instance.
+     */
+    soft_timer_handle_t* p_htim;
+
+    /**
+     * @brief Flags if this scheduler has already been initialized.
+     *
+     * @note Avoids multiple initializations that would reset running timers.
+     */
+    bool is_initialized;
+
+    /**
+     * @brief Physical timer max counter value.
+     *
+     * @note Usually 16-bit (0xFFFF) or 32-bit (0xFFFFFFFF), always a power of
+     *       two minus one so absolute time maps to counter value by masking.
+     */
+    uint32_t counter_max;
+
+    /**
+     * @brief Absolute time at last counter overflow.
+     */
+    volatile uint32_t overflow_ticks;
+
+    /**
+     * @brief Time in which the hardware timer was not counting.
+     */
+    uint32_t time_offset_ticks;
+
+    /**
+     * @brief Deadline the hardware compare is programmed for.
+     */
+    uint32_t compare_deadline;
+
+    /**
+     * @brief Flags a programmed hardware compare.
+     */
+    bool compare_armed;
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_LPTIM
+
+    /**
+     * @brief Flags a compare register write that may not be completed yet.
+     */
+    bool compare_write_pending;
+
+#endif
+
+    /**
+     * @brief Actual timer tick frequency.
+     */
+    uint32_t tick_frequency_hz;
+
+    /**
+     * @brief Hardware prescaler register value.
+     */
+    uint32_t prescaler;
+
+    /**
+     * @brief Hardware timer input clock frequency.
+     */
+    uint32_t clock_hz;
+
+    /**
+     * @brief Input clock cycles in each tick, the tick frequency is exactly clock_hz / clock_divider.
+     */
+    uint32_t clock_divider;
+
+    /**
+     * @brief Deviation of the tick frequency from the requested one, in parts per million.
+     */
+    int32_t error_ppm;
+
+    /**
+     * @brief Timer ticks in each millisecond, Q32.32 fixed point.
+     *
+     * @note Used to convert reload values given in time units, also covers
+     *       tick frequencies different from the requested due to prescaler limits.
+     */
+    uint64_t ticks_per_ms_q32;
+
+    /**
+     * @brief Timer ticks in each microsecond, Q32.32 fixed point.
+     */
+    uint64_t ticks_per_us_q32;
+
+#if SOFT_TIMER_STATS
+
+    /**
+     * @brief Run time statistics.
+     */
+    soft_timer_stats_t stats;
+
+    /**
+     * @brief Timers expired in the current compare interrupt.
+     */
+    uint32_t stats_isr_expired;
+
+#endif
+};
+
+/*****************************************
+ * Private Variables
+ *****************************************/
+
+/**
+ * @brief Array of available scheduler instances.
+ *
+ * @note The first one is the default scheduler, used by functions that do
+ *       not take a scheduler.
+ */
+static soft_timer_scheduler_t m_schedulers[SOFT_TIMER_MAX_SCHEDULERS];
+
+/**
+ * @brief Number of initialized schedulers.
+ */
+static uint8_t m_scheduler_count = 0;
+
+#if SOFT_TIMER_TRACE
+
+/**
+ * @brief Trace event buffer, indexed modulo its size.
+ */
+static volatile soft_timer_trace_event_t m_trace_events[SOFT_TIMER_TRACE_SIZE];
+
+/**
+ * @brief Count of reserved trace slots, written by the recording contexts.
+ */
+static volatile uint32_t m_trace_head = 0;
+
+/**
+ * @brief Count of trace slots already read, written by the reader only.
+ */
+static volatile uint32_t m_trace_tail = 0;
+
+/**
+ * @brief Count of trace events dropped on a full buffer.
+ */
+static volatile uint32_t m_trace_dropped = 0;
+
+#endif
+
+/*****************************************
+ * Public Functions Bodies Definitions
+ *****************************************/
+
+void soft_timer_init(soft_timer_handle_t* htim, uint32_t max_reload_ms) {
+    soft_timer_init_ex(htim, max_reload_ms, DEFAULT_TICK_FREQUENCY_HZ);
+}
+
+void soft_timer_init_ex(soft_timer_handle_t* htim, uint32_t max_reload_ms, uint32_t tick_frequency_hz) {
+    soft_timer_scheduler_init(htim, max_reload_ms, tick_frequency_hz);
+}
+
+soft_timer_t* soft_timer_create(void) {
+    return soft_timer_scheduler_timer_create(&m_schedulers[0]);
+}
+
+soft_timer_t* soft_timer_create_static(soft_timer_storage_t* p_storage) {
+    return soft_timer_scheduler_timer_create_static(&m_schedulers[0], p_storage);
+}
+
+void soft_timer_destroy(soft_timer_t** timer) {
+    if (!timer_is_valid(*timer) || ((*timer)->state != TIMER_STATE_STOPPED)) {
+        return;
+    }
+
+    soft_timer_scheduler_t* p_scheduler = (*timer)->p_scheduler;
+
+    (*timer)->state = TIMER_STATE_FREE;
+
+    if (!TIMER_ID_IS_STATIC((*timer)->id)) {
+        (*timer)->p_next = p_scheduler->p_free_timers;
+        p_scheduler->p_free_timers = *timer;
+    }
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+    else {
+        p_scheduler->p_static_timers[(*timer)->id - SOFT_TIMER_MAX_TIMERS] = NULL;
+        p_scheduler->static_free_ids[p_scheduler->static_free_count] = (*timer)->id;
+        p_scheduler->static_free_count++;
+    }
+#endif
+
+    *timer = NULL;
+}
+
+soft_timer_status_t soft_timer_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
+                                   bool repeat) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return timer_set(timer, callback, time_to_ticks(reload_ms, timer->p_scheduler->ticks_per_ms_q32), repeat, 0);
+}
+
+soft_timer_status_t soft_timer_set_us(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_us,
+                                      bool repeat) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return timer_set(timer, callback, time_to_ticks(reload_us, timer->p_scheduler->ticks_per_us_q32), repeat, 0);
+}
+
+soft_timer_status_t soft_timer_set_ticks(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ticks,
+                                         bool repeat) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return timer_set(timer, callback, reload_ticks, repeat, 0);
+}
+
+soft_timer_status_t soft_timer_set_ex(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
+                                      bool repeat, uint32_t slack_ms) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    uint64_t ticks_per_ms_q32 = timer->p_scheduler->ticks_per_ms_q32;
+
+    return timer_set(timer, callback, time_to_ticks(reload_ms, ticks_per_ms_q32), repeat,
+                     time_to_ticks(slack_ms, ticks_per_ms_q32));
+}
+
+soft_timer_status_t soft_timer_set_period(soft_timer_t* timer, uint32_t period_ms, bool immediate) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return timer_period_set(timer, time_to_ticks(period_ms, timer->p_scheduler->ticks_per_ms_q32), immediate);
+}
+
+soft_timer_status_t soft_timer_set_period_ticks(soft_timer_t* timer, uint32_t period_ticks, bool immediate) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return timer_period_set(timer, period_ticks, immediate);
+}
+
+soft_timer_status_t soft_timer_context_set(soft_timer_t* timer, void* p_context) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    timer->p_context = p_context;
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+void* soft_timer_context_get(soft_timer_t* timer) {
+    return timer->p_context;
+}
+
+soft_timer_status_t soft_timer_catch_up_set(soft_timer_t* timer, soft_timer_catch_up_t catch_up) {
+    if (!timer_is_valid(timer) || (catch_up > SOFT_TIMER_CATCH_UP_REPORT)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    timer->catch_up = catch_up;
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_priority_set(soft_timer_t* timer, uint8_t priority) {
+    if (!timer_is_valid(timer) || (priority >= SOFT_TIMER_PRIORITY_LEVELS)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    timer->priority = priority;
+#endif
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+uint32_t soft_timer_overruns_get(soft_timer_t* timer) {
+    // Each counter has a single writer, so no critical section is needed
+    uint32_t overruns = timer->overruns - timer->overruns_ack;
+
+    timer->overruns_ack += overruns;
+
+    return overruns;
+}
+
+uint32_t soft_timer_tick_frequency_get(void) {
+    return soft_timer_scheduler_tick_frequency_get(&m_schedulers[0]);
+}
+
+void soft_timer_scaling_get(soft_timer_scaling_t* p_scaling) {
+    soft_timer_scheduler_scaling_get(&m_schedulers[0], p_scaling);
+}
+
+uint32_t soft_timer_now(void) {
+    return soft_timer_scheduler_now(&m_schedulers[0]);
+}
+
+soft_timer_status_t soft_timer_start(soft_timer_t* timer) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(p_scheduler)) {
+        command_post(timer, TIMER_COMMAND_START);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (timer->state != TIMER_STATE_STOPPED) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer_start(timer, hard_timer_now(p_scheduler));
+
+    timers_schedule(p_scheduler);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_stop(soft_timer_t* timer) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(p_scheduler)) {
+        command_post(timer, TIMER_COMMAND_STOP);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (timer->state != TIMER_STATE_RUNNING) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer_stop(timer);
+
+    timers_schedule(p_scheduler);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_restart(soft_timer_t* timer) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(timer->p_scheduler)) {
+        command_post(timer, TIMER_COMMAND_RESTART);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (timer->state == TIMER_STATE_FREE) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer_restart_now(timer);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_start_group(soft_timer_t* const* p_timers, uint16_t count) {
+    if (!group_is_valid(p_timers, count)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    soft_timer_scheduler_t* p_scheduler = p_timers[0]->p_scheduler;
+
+    // Single reference instant for the whole group
+    uint32_t now = hard_timer_now(p_scheduler);
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(p_scheduler)) {
+        for (uint16_t i = 0; i < count; i++) {
+            command_write(p_timers[i], TIMER_COMMAND_START, now);
+        }
+
+        timers_update_request(p_scheduler);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (!group_state_is(p_timers, count, TIMER_STATE_STOPPED)) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        // Timer listed twice is already running
+        if (p_timers[i]->state == TIMER_STATE_STOPPED) {
+            timer_start(p_timers[i], now);
+        }
+    }
+
+    timers_schedule(p_scheduler);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_stop_group(soft_timer_t* const* p_timers, uint16_t count) {
+    if (!group_is_valid(p_timers, count)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    soft_timer_scheduler_t* p_scheduler = p_timers[0]->p_scheduler;
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(p_scheduler)) {
+        uint32_t now = hard_timer_now(p_scheduler);
+
+        for (uint16_t i = 0; i < count; i++) {
+            command_write(p_timers[i], TIMER_COMMAND_STOP, now);
+        }
+
+        timers_update_request(p_scheduler);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (!group_state_is(p_timers, count, TIMER_STATE_RUNNING)) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        timer_stop(p_timers[i]);
+    }
+
+    timers_schedule(p_scheduler);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_start_at(soft_timer_t* timer, uint32_t deadline_ticks) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return timer_start_deadline(timer, deadline_ticks);
+}
+
+soft_timer_status_t soft_timer_start_aligned(soft_timer_t* timer, soft_timer_t* reference, uint32_t phase_ticks) {
+    if (!timer_is_valid(timer) || !timer_is_valid(reference) || (reference == timer) ||
+        (reference->p_scheduler != timer->p_scheduler)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    if (reference->state != TIMER_STATE_RUNNING) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    uint32_t reference_due = reference->due;
+    uint32_t reference_period = reference->reload_ticks;
+    uint32_t deadline = reference_due + phase_ticks;
+
+    if (reference->repeat) {
+        // Counted from the previous reference timeout, one period is added if already passed
+        deadline = reference_due - reference_period + (phase_ticks % reference_period);
+
+        if ((int32_t) (deadline - hard_timer_now(timer->p_scheduler)) <= 0) {
+            deadline += reference_period;
+        }
+    }
+
+    return timer_start_deadline(timer, deadline);
+}
+
+soft_timer_status_t soft_timer_reset_countdown(soft_timer_t* timer) {
+    if (!timer_is_valid(timer)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(timer->p_scheduler)) {
+        command_post(timer, TIMER_COMMAND_RESET);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (timer->state != TIMER_STATE_RUNNING) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer_restart_now(timer);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+bool soft_timer_is_stopped(soft_timer_t* timer) {
+    return (timer->state == TIMER_STATE_STOPPED);
+}
+
+uint32_t soft_timer_next_expiry_ms(void) {
+    return soft_timer_scheduler_next_expiry_ms(&m_schedulers[0]);
+}
+
+uint32_t soft_timer_next_expiry_ticks(void) {
+    return soft_timer_scheduler_next_expiry_ticks(&m_schedulers[0]);
+}
+
+void soft_timer_sleep_compensate_ms(uint32_t sleep_time_ms) {
+    soft_timer_scheduler_sleep_compensate_ms(&m_schedulers[0], sleep_time_ms);
+}
+
+soft_timer_status_t soft_timer_delay_ms(uint32_t delay_ms) {
+    return soft_timer_scheduler_delay_ms(&m_schedulers[0], delay_ms);
+}
+
+soft_timer_status_t soft_timer_wait(volatile bool* p_event, uint32_t timeout_ms) {
+    return soft_timer_scheduler_wait(&m_schedulers[0], p_event, timeout_ms);
+}
+
+soft_timer_status_t soft_timer_timeout_start(soft_timer_timeout_t* p_timeout, uint32_t timeout_ms) {
+    return soft_timer_scheduler_timeout_start(&m_schedulers[0], p_timeout, timeout_ms);
+}
+
+bool soft_timer_timeout_expired(const soft_timer_timeout_t* p_timeout) {
+    return (int32_t) (hard_timer_now(p_timeout->p_scheduler) - p_timeout->deadline_ticks) >= 0;
+}
+
+void soft_timer_period_elapsed_callback(void) {
+    soft_timer_scheduler_period_elapsed_callback(&m_schedulers[0]);
+}
+
+void soft_timer_output_compare_callback(void) {
+    soft_timer_scheduler_output_compare_callback(&m_schedulers[0]);
+}
+
+soft_timer_scheduler_t* soft_timer_scheduler_init(soft_timer_handle_t* htim, uint32_t max_reload_ms,
+                                                  uint32_t tick_frequency_hz) {
+    soft_timer_scheduler_t* p_scheduler = soft_timer_scheduler_get(htim);
+
+    if (p_scheduler == NULL) {
+        if (m_scheduler_count >= SOFT_TIMER_MAX_SCHEDULERS) {
+            return NULL;
+        }
+
+        p_scheduler = &m_schedulers[m_scheduler_count];
+        m_scheduler_count++;
+    }
+
+    scheduler_init(p_scheduler, htim, max_reload_ms, tick_frequency_hz);
+
+    return p_scheduler;
+}
+
+soft_timer_scheduler_t* soft_timer_scheduler_get(soft_timer_handle_t* htim) {
+    for (uint8_t i = 0; i < m_scheduler_count; i++) {
+        if (m_schedulers[i].p_htim == htim) {
+            return &m_schedulers[i];
+        }
+    }
+
+    return NULL;
+}
+
+soft_timer_t* soft_timer_scheduler_timer_create(soft_timer_scheduler_t* p_scheduler) {
+    if (p_scheduler == NULL) {
+        return NULL;
+    }
+
+    soft_timer_t* p_timer = p_scheduler->p_free_timers;
+
+    if (p_timer == NULL) {
+        return NULL;
+    }
+
+    p_scheduler->p_free_timers = p_timer->p_next;
+    p_timer->p_next = NULL;
+    p_timer->p_context = NULL;
+    p_timer->catch_up = SOFT_TIMER_CATCH_UP_BURST;
+    p_timer->overruns = 0;
+    p_timer->overruns_ack = 0;
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    p_timer->priority = SOFT_TIMER_PRIORITY_LEVELS - 1;
+#endif
+#if SOFT_TIMER_STATS
+    p_timer->cycles_max = 0;
+#endif
+    p_timer->state = TIMER_STATE_STOPPED;
+
+    return p_timer;
+}
+
+soft_timer_t* soft_timer_scheduler_timer_create_static(soft_timer_scheduler_t* p_scheduler,
+                                                       soft_timer_storage_t* p_storage) {
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+    if ((p_scheduler == NULL) || (p_storage == NULL) || (p_scheduler->static_free_count == 0)) {
+        return NULL;
+    }
+
+    soft_timer_t* p_timer = (soft_timer_t*) p_storage;
+
+    p_timer->state = TIMER_STATE_FREE;
+    p_timer->p_scheduler = p_scheduler;
+    p_timer->p_context = NULL;
+    p_timer->catch_up = SOFT_TIMER_CATCH_UP_BURST;
+    p_timer->overruns = 0;
+    p_timer->overruns_ack = 0;
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    p_timer->priority = SOFT_TIMER_PRIORITY_LEVELS - 1;
+#endif
+#if SOFT_TIMER_STATS
+    p_timer->cycles_max = 0;
+#endif
+    p_timer->p_prev = NULL;
+    p_timer->p_next = NULL;
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
+    p_timer->slot = WHEEL_SLOT_NONE;
+#endif
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+    p_timer->ready = false;
+#endif
+
+    // Storage may hold a stale id and queue links, so it is never passed to the queue before this point
+    p_scheduler->static_free_count--;
+    p_timer->id = p_scheduler->static_free_ids[p_scheduler->static_free_count];
+    p_scheduler->p_static_timers[p_timer->id - SOFT_TIMER_MAX_TIMERS] = p_timer;
+    p_timer->repeat = false;
+    p_timer->state = TIMER_STATE_STOPPED;
+
+    return p_timer;
+#else
+    UNUSED(p_scheduler);
+    UNUSED(p_storage);
+
+    return NULL;
+#endif
+}
+
+uint32_t soft_timer_scheduler_tick_frequency_get(soft_timer_scheduler_t* p_scheduler) {
+    return p_scheduler->tick_frequency_hz;
+}
+
+void soft_timer_scheduler_scaling_get(soft_timer_scheduler_t* p_scheduler, soft_timer_scaling_t* p_scaling) {
+    p_scaling->tick_frequency_hz = p_scheduler->tick_frequency_hz;
+    p_scaling->prescaler = p_scheduler->prescaler;
+    p_scaling->clock_hz = p_scheduler->clock_hz;
+    p_scaling->resolution_ns = (((uint64_t) p_scheduler->clock_divider * NS_PER_S) + (p_scheduler->clock_hz / 2)) /
+                               p_scheduler->clock_hz;
+    p_scaling->error_ppm = p_scheduler->error_ppm;
+    p_scaling->ticks_per_ms_q32 = p_scheduler->ticks_per_ms_q32;
+    p_scaling->ticks_per_us_q32 = p_scheduler->ticks_per_us_q32;
+}
+
+uint32_t soft_timer_scheduler_now(soft_timer_scheduler_t* p_scheduler) {
+    return hard_timer_now(p_scheduler);
+}
+
+uint32_t soft_timer_scheduler_next_expiry_ms(soft_timer_scheduler_t* p_scheduler) {
+    uint32_t next_expiry_ticks = soft_timer_scheduler_next_expiry_ticks(p_scheduler);
+
+    if (next_expiry_ticks == SOFT_TIMER_NO_EXPIRY) {
+        return SOFT_TIMER_NO_EXPIRY;
+    }
+
+    return ((uint64_t) next_expiry_ticks * p_scheduler->clock_divider * MS_PER_S) / p_scheduler->clock_hz;
+}
+
+uint32_t soft_timer_scheduler_next_expiry_ticks(soft_timer_scheduler_t* p_scheduler) {
+    uint32_t next_deadline;
+
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN
+    // Called from any context, so the earliest deadline cache is read but never refreshed here
+    if (!scan_next_deadline_peek(p_scheduler, &next_deadline)) {
+        return SOFT_TIMER_NO_EXPIRY;
+    }
+#else
+    if (!queue_next_deadline(p_scheduler, &next_deadline)) {
+        return SOFT_TIMER_NO_EXPIRY;
+    }
+#endif
+
+    int32_t ticks_until_deadline = next_deadline - hard_timer_now(p_scheduler);
+
+    return (ticks_until_deadline > 0) ? (uint32_t) ticks_until_deadline : 0;
+}
+
+void soft_timer_scheduler_sleep_compensate_ms(soft_timer_scheduler_t* p_scheduler, uint32_t sleep_time_ms) {
+    uint32_t sleep_ticks = time_to_ticks(sleep_time_ms, p_scheduler->ticks_per_ms_q32);
+
+    // Programmed compare register now stands for a later time
+    p_scheduler->time_offset_ticks += sleep_ticks;
+    p_scheduler->compare_deadline += sleep_ticks;
+
+    timers_update_request(p_scheduler);
+}
+
+soft_timer_status_t soft_timer_scheduler_delay_ms(soft_timer_scheduler_t* p_scheduler, uint32_t delay_ms) {
+    soft_timer_status_t status = scheduler_wait(p_scheduler, NULL, delay_ms);
+
+    return (status == SOFT_TIMER_STATUS_TIMEOUT) ? SOFT_TIMER_STATUS_SUCCESS : status;
+}
+
+soft_timer_status_t soft_timer_scheduler_wait(soft_timer_scheduler_t* p_scheduler, volatile bool* p_event,
+                                              uint32_t timeout_ms) {
+    if (p_event == NULL) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    return scheduler_wait(p_scheduler, p_event, timeout_ms);
+}
+
+soft_timer_status_t soft_timer_scheduler_timeout_start(soft_timer_scheduler_t* p_scheduler,
+                                                       soft_timer_timeout_t* p_timeout, uint32_t timeout_ms) {
+    if ((p_scheduler == NULL) || !p_scheduler->is_initialized || (p_timeout == NULL)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    uint32_t timeout_ticks = time_to_ticks(timeout_ms, p_scheduler->ticks_per_ms_q32);
+
+    if (timeout_ticks > MAX_TIMEOUT_TICKS) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    p_timeout->p_scheduler = p_scheduler;
+    p_timeout->deadline_ticks = hard_timer_now(p_scheduler) + timeout_ticks;
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+__weak void soft_timer_wait_idle(soft_timer_scheduler_t* p_scheduler) {
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+    uint32_t next_expiry_ticks = soft_timer_scheduler_next_expiry_ticks(p_scheduler);
+
+    if ((next_expiry_ticks == 0) || (next_expiry_ticks == SOFT_TIMER_NO_EXPIRY)) {
+        next_expiry_ticks = 1;
+    }
+
+    soft_timer_host_advance(p_scheduler->p_htim, next_expiry_ticks);
+#else
+    UNUSED(p_scheduler);
+
+    __WFI();
+#endif
+}
+
+void soft_timer_scheduler_period_elapsed_callback(soft_timer_scheduler_t* p_scheduler) {
+    p_scheduler->overflow_ticks += p_scheduler->counter_max + 1;
+}
+
+void soft_timer_scheduler_output_compare_callback(soft_timer_scheduler_t* p_scheduler) {
+#if SOFT_TIMER_STATS
+    uint32_t start_cycles = DWT->CYCCNT;
+
+    p_scheduler->stats_isr_expired = 0;
+#endif
+
+#if SOFT_TIMER_CONCURRENT_API
+    p_scheduler->update_ipsr = __get_IPSR();
+
+    commands_apply(p_scheduler);
+#endif
+
+    timers_update(p_scheduler);
+
+#if SOFT_TIMER_STATS
+    stats_isr_record(p_scheduler, DWT->CYCCNT - start_cycles);
+#endif
+}
+
+#if SOFT_TIMER_HARDWARE != SOFT_TIMER_HARDWARE_HOST
+
+void soft_timer_irq_handler(void) {
+    soft_timer_scheduler_irq_handler(&m_schedulers[0]);
+}
+
+void soft_timer_scheduler_irq_handler(soft_timer_scheduler_t* p_scheduler) {
+    // Masked so higher priority interrupts never read time with the flag cleared but not counted
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t events = hard_timer_events_take(p_scheduler);
+
+    // Overflow is counted first, so the update sees the current time base
+    if ((events & HARD_TIMER_EVENT_OVERFLOW) != 0) {
+        soft_timer_scheduler_period_elapsed_callback(p_scheduler);
+    }
+
+    __set_PRIMASK(primask);
+
+    if ((events & HARD_TIMER_EVENT_COMPARE) != 0) {
+        soft_timer_scheduler_output_compare_callback(p_scheduler);
+    }
+}
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_TIM
+
+soft_timer_status_t soft_timer_trigger_start(soft_timer_handle_t* htim_trigger, uint32_t channel,
+                                             uint32_t period_ticks) {
+    return soft_timer_scheduler_trigger_start(&m_schedulers[0], htim_trigger, channel, period_ticks);
+}
+
+soft_timer_status_t soft_timer_trigger_stop(soft_timer_handle_t* htim_trigger, uint32_t channel) {
+    if ((htim_trigger == NULL) || !trigger_channel_is_valid(channel)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    if (channel != TIM_CHANNEL_ALL) {
+        htim_trigger->Instance->CCER &= ~(TIM_CCER_CC1E << channel);
+    }
+
+    // HAL disable macro keeps the counter running while any channel is enabled
+    htim_trigger->Instance->CR1 &= ~TIM_CR1_CEN;
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t soft_timer_scheduler_trigger_start(soft_timer_scheduler_t* p_scheduler,
+                                                       soft_timer_handle_t* htim_trigger, uint32_t channel,
+                                                       uint32_t period_ticks) {
+    if ((p_scheduler == NULL) || !p_scheduler->is_initialized) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    if ((htim_trigger == NULL) || (soft_timer_scheduler_get(htim_trigger) != NULL) ||
+        !trigger_channel_is_valid(channel) || (period_ticks == 0)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+#if defined(IS_TIM_32B_COUNTER_INSTANCE)
+    uint64_t counter_period = IS_TIM_32B_COUNTER_INSTANCE(htim_trigger->Instance) ? (1ULL << 32) : (1ULL << 16);
+#else
+    uint64_t counter_period = 1ULL << 16;
+#endif
+
+    // Smallest prescaler fitting the counter keeps the finest period resolution
+    uint64_t cycles = trigger_cycles_get(p_scheduler, htim_trigger, period_ticks);
+    uint64_t divider = (cycles + counter_period - 1) / counter_period;
+
+    if (divider > (PRESCALER_MAX_VALUE + 1)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    divider = max(divider, 1);
+    uint64_t reload = (cycles + (divider / 2)) / divider;
+
+    // Counter does not run with a zero auto reload
+    if (reload < 2) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    // Stopped even with a channel still enabled by a previous start
+    htim_trigger->Instance->CR1 &= ~TIM_CR1_CEN;
+    __HAL_TIM_SET_PRESCALER(htim_trigger, divider - 1);
+    __HAL_TIM_SET_AUTORELOAD(htim_trigger, reload - 1);
+
+    if (channel != TIM_CHANNEL_ALL) {
+        // Half period compare makes PWM mode a square wave, any value suits the others
+        __HAL_TIM_SET_COMPARE(htim_trigger, channel, reload / 2);
+        htim_trigger->Instance->CCER |= TIM_CCER_CC1E << channel;
+
+        if (IS_TIM_BREAK_INSTANCE(htim_trigger->Instance)) {
+            __HAL_TIM_MOE_ENABLE(htim_trigger);
+        }
+    }
+
+    // Update event loads the prescaler and resets the counter
+    HAL_TIM_GenerateEvent(htim_trigger, TIM_EVENTSOURCE_UPDATE);
+    __HAL_TIM_ENABLE(htim_trigger);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+#endif
+
+#if SOFT_TIMER_STATS
+
+void soft_timer_stats_get(soft_timer_stats_t* p_stats) {
+    soft_timer_scheduler_stats_get(&m_schedulers[0], p_stats);
+}
+
+void soft_timer_stats_reset(void) {
+    soft_timer_scheduler_stats_reset(&m_schedulers[0]);
+}
+
+void soft_timer_scheduler_stats_get(soft_timer_scheduler_t* p_scheduler, soft_timer_stats_t* p_stats) {
+    *p_stats = p_scheduler->stats;
+}
+
+void soft_timer_scheduler_stats_reset(soft_timer_scheduler_t* p_scheduler) {
+    p_scheduler->stats = (soft_timer_stats_t) {0};
+}
+
+uint32_t soft_timer_callback_cycles_max_get(soft_timer_t* timer) {
+    return timer->cycles_max;
+}
+
+#endif
+
+#if SOFT_TIMER_TRACE
+
+uint32_t soft_timer_trace_read(soft_timer_trace_event_t* p_events, uint32_t max_events) {
+    uint32_t count = 0;
+    uint32_t tail = m_trace_tail;
+
+    if (p_events == NULL) {
+        return 0;
+    }
+
+    while ((count < max_events) && (tail != m_trace_head)) {
+        volatile soft_timer_trace_event_t* p_event = &m_trace_events[tail % SOFT_TIMER_TRACE_SIZE];
+
+        // Reserved by a writer that was interrupted before committing it
+        if (p_event->type == SOFT_TIMER_TRACE_NONE) {
+            break;
+        }
+
+        __DMB();
+        p_events[count] = *p_event;
+        count++;
+
+        // Slot is released only after it was copied
+        p_event->type = SOFT_TIMER_TRACE_NONE;
+        __DMB();
+        tail++;
+        m_trace_tail = tail;
+    }
+
+    return count;
+}
+
+uint32_t soft_timer_trace_dropped_get(void) {
+    return m_trace_dropped;
+}
+
+#endif
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+
+void soft_timer_host_advance(soft_timer_handle_t* htim, uint32_t ticks) {
+    soft_timer_scheduler_t* p_scheduler = soft_timer_scheduler_get(htim);
+
+    if (p_scheduler == NULL) {
+        return;
+    }
+
+    host_interrupts_run(p_scheduler);
+
+    while (ticks > 0) {
+        uint64_t period = (uint64_t) p_scheduler->counter_max + 1;
+        uint64_t step = period - htim->counter;
+
+        if (htim->compare_enabled) {
+            uint64_t ticks_to_compare = (htim->compare - htim->counter) & p_scheduler->counter_max;
+
+            step = min(step, (ticks_to_compare == 0) ? period : ticks_to_compare);
+        }
+
+        step = min(step, ticks);
+        ticks -= step;
+        htim->counter = (htim->counter + step) & p_scheduler->counter_max;
+
+        if (htim->counter == 0) {
+            htim->overflow_pending = true;
+        }
+
+        if (htim->compare_enabled && (htim->counter == htim->compare)) {
+            htim->compare_pending = true;
+        }
+
+        host_interrupts_run(p_scheduler);
+    }
+}
+
+#endif
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+
+void soft_timer_dispatch(void) {
+    for (uint8_t priority = 0; priority < SOFT_TIMER_PRIORITY_LEVELS; priority++) {
+        soft_timer_dispatch_priority(priority);
+    }
+}
+
+void soft_timer_dispatch_priority(uint8_t priority) {
+    if (priority >= SOFT_TIMER_PRIORITY_LEVELS) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < m_scheduler_count; i++) {
+        ready_queue_dispatch(&m_schedulers[i], priority);
+    }
+}
+
+__weak void soft_timer_dispatch_request(void) {
+}
+
+__weak void soft_timer_dispatch_priority_request(uint8_t priority) {
+    UNUSED(priority);
+
+    soft_timer_dispatch_request();
+}
+
+#endif
+
+/*****************************************
+ * Private Functions Bodies Definitions
+ *****************************************/
+
+bool timer_is_valid(soft_timer_t* timer) {
+    for (uint8_t i = 0; i < m_scheduler_count; i++) {
+        soft_timer_t* first_timer = &(m_schedulers[i].timers[0]);
+        soft_timer_t* last_timer = &(m_schedulers[i].timers[SOFT_TIMER_MAX_TIMERS]);
+
+        if ((timer >= first_timer) && (timer < last_timer)) {
+            return true;
+        }
+    }
+
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+    if ((timer == NULL) || !TIMER_ID_IS_STATIC(timer->id) ||
+        ((timer->id - SOFT_TIMER_MAX_TIMERS) >= SOFT_TIMER_MAX_STATIC_TIMERS)) {
+        return false;
+    }
+
+    // User memory may hold anything, so the scheduler is checked before use
+    for (uint8_t i = 0; i < m_scheduler_count; i++) {
+        if (timer->p_scheduler == &m_schedulers[i]) {
+            return m_schedulers[i].p_static_timers[timer->id - SOFT_TIMER_MAX_TIMERS] == timer;
+        }
+    }
+#endif
+
+    return false;
+}
+
+bool group_is_valid(soft_timer_t* const* p_timers, uint16_t count) {
+    if ((p_timers == NULL) || (count == 0)) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (!timer_is_valid(p_timers[i]) || (p_timers[i]->p_scheduler != p_timers[0]->p_scheduler)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool group_state_is(soft_timer_t* const* p_timers, uint16_t count, uint8_t state) {
+    for (uint16_t i = 0; i < count; i++) {
+        if (p_timers[i]->state != state) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+soft_timer_status_t scheduler_wait(soft_timer_scheduler_t* p_scheduler, volatile bool* p_event,
+                                   uint32_t timeout_ms) {
+    if ((p_scheduler == NULL) || !p_scheduler->is_initialized) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    uint32_t timeout_ticks = time_to_ticks(timeout_ms, p_scheduler->ticks_per_ms_q32);
+
+    if (timeout_ticks > MAX_TIMEOUT_TICKS) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    soft_timer_t* timer = soft_timer_scheduler_timer_create(p_scheduler);
+
+    if (timer == NULL) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    uint32_t deadline = hard_timer_now(p_scheduler) + timeout_ticks;
+    bool event = (p_event != NULL) && *p_event;
+    int32_t remaining_ticks;
+
+    // Reload may be shorter than the timeout, as with SOFT_TIMER_PACKED
+    while (!event && ((remaining_ticks = deadline - hard_timer_now(p_scheduler)) > 0)) {
+        timer_set(timer, NULL, min((uint32_t) remaining_ticks, MAX_RELOAD_TICKS), false, 0);
+        soft_timer_start(timer);
+
+        event = timer_wait(timer, p_event);
+
+        if (event) {
+            soft_timer_stop(timer);
+            timer_wait(timer, NULL);
+        }
+    }
+
+    soft_timer_destroy(&timer);
+
+    return event ? SOFT_TIMER_STATUS_SUCCESS : SOFT_TIMER_STATUS_TIMEOUT;
+}
+
+bool timer_wait(soft_timer_t* timer, volatile bool* p_event) {
+    for (;;) {
+        // Masked so an interrupt between the check and the sleep still wakes the core
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        bool event = (p_event != NULL) && *p_event;
+        bool done = event || timer_is_idle(timer);
+
+        if (!done) {
+            soft_timer_wait_idle(timer->p_scheduler);
+        }
+
+        __set_PRIMASK(primask);
+
+        if (done) {
+            return event;
+        }
+    }
+}
+
+bool timer_is_idle(soft_timer_t* timer) {
+#if SOFT_TIMER_CONCURRENT_API
+    uint32_t pending = timer->p_scheduler->command_pending[timer->id / 32];
+
+    if ((pending & (1UL << (timer->id % 32))) != 0) {
+        return false;
+    }
+#endif
+
+    return (timer->state == TIMER_STATE_STOPPED);
+}
+
+void scheduler_init(soft_timer_scheduler_t* p_scheduler, soft_timer_handle_t* htim, uint32_t max_reload_ms,
+                    uint32_t tick_frequency_hz) {
+    // Handle and counter mask describe the running time base, kept as they are
+    if (p_scheduler->is_initialized) {
+        return;
+    }
+
+    p_scheduler->p_htim = htim;
+    p_scheduler->counter_max = max_reload_ms;
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_LPTIM
+    p_scheduler->counter_max = min(p_scheduler->counter_max, LPTIM_COUNTER_MAX);
+#endif
+
+    while ((p_scheduler->counter_max & (p_scheduler->counter_max + 1)) != 0) {
+        p_scheduler->counter_max >>= 1;
+    }
+
+    for (uint16_t i = SOFT_TIMER_MAX_TIMERS; i > 0; i--) {
+        soft_timer_t* p_timer = &p_scheduler->timers[i - 1];
+
+        p_timer->p_scheduler = p_scheduler;
+        timer_stop(p_timer);
+        p_timer->state = TIMER_STATE_FREE;
+        p_timer->id = i - 1;
+        p_timer->p_next = p_scheduler->p_free_timers;
+        p_scheduler->p_free_timers = p_timer;
+    }
+
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+    for (uint8_t i = 0; i < SOFT_TIMER_MAX_STATIC_TIMERS; i++) {
+        p_scheduler->static_free_ids[i] = TOTAL_TIMERS - 1 - i;
+    }
+
+    p_scheduler->static_free_count = SOFT_TIMER_MAX_STATIC_TIMERS;
+#endif
+
+#if SOFT_TIMER_CONCURRENT_API
+    p_scheduler->update_ipsr = IPSR_NONE;
+#endif
+
+#if SOFT_TIMER_STATS
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    hard_timer_init(p_scheduler, tick_frequency_hz);
+
+    // From the exact clock ratio, so rounding of the tick frequency does not drift timeouts
+    uint64_t clock_divider = p_scheduler->clock_divider;
+
+    p_scheduler->ticks_per_ms_q32 = TICKS_PER_UNIT_Q32(p_scheduler->clock_hz, clock_divider * MS_PER_S);
+    p_scheduler->ticks_per_us_q32 = TICKS_PER_UNIT_Q32(p_scheduler->clock_hz, clock_divider * US_PER_S);
+
+    p_scheduler->is_initialized = true;
+}
+
+void timer_stop(soft_timer_t* timer) {
+#if SOFT_TIMER_TRACE
+    if (timer->state == TIMER_STATE_RUNNING) {
+        trace_record(timer->p_scheduler, SOFT_TIMER_TRACE_STOP, timer->id, 0);
+    }
+#endif
+
+    queue_remove(timer);
+
+    timer->state = TIMER_STATE_STOPPED;
+    timer->repeat = false;
+}
+
+soft_timer_status_t timer_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ticks,
+                              bool repeat, uint32_t slack_ticks) {
+    if ((reload_ticks == 0) || (reload_ticks > MAX_RELOAD_TICKS) || (slack_ticks > MAX_SLACK_TICKS)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    // Delayed deadline must still be comparable with current time
+    if (slack_ticks > (MAX_TIMEOUT_TICKS - reload_ticks)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    if (timer->state != TIMER_STATE_STOPPED) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer->reload_ticks = reload_ticks;
+    timer->repeat = repeat;
+    timer->slack_ticks = slack_ticks;
+    timer->callback = callback;
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+soft_timer_status_t timer_period_set(soft_timer_t* timer, uint32_t period_ticks, bool immediate) {
+    if ((period_ticks == 0) || (period_ticks > MAX_RELOAD_TICKS) ||
+        (timer->slack_ticks > (MAX_TIMEOUT_TICKS - period_ticks))) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(timer->p_scheduler)) {
+        period_request_write(timer, period_ticks, immediate);
+        timers_update_request(timer->p_scheduler);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (timer->state == TIMER_STATE_FREE) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer_period_apply(timer, period_ticks, immediate);
+
+    if (immediate) {
+        timers_schedule(timer->p_scheduler);
+    }
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+void timer_period_apply(soft_timer_t* timer, uint32_t period_ticks, bool immediate) {
+    uint32_t period_start = timer->due - timer->reload_ticks;
+
+    timer->reload_ticks = period_ticks;
+
+    // Out of the queue while its callback runs, requeued with the new period
+    if (!immediate || (timer->state != TIMER_STATE_RUNNING) || !queue_contains(timer)) {
+        return;
+    }
+
+    uint32_t due = period_start + period_ticks;
+    uint32_t now = hard_timer_now(timer->p_scheduler);
+
+    if ((int32_t) (due - now) < 0) {
+        due = now;
+    }
+
+    queue_remove(timer);
+    timer_queue(timer, due);
+}
+
+void timer_queue(soft_timer_t* timer, uint32_t due) {
+    timer->due = due;
+
+    queue_insert(timer, slack_apply(due, timer->slack_ticks));
+}
+
+uint32_t slack_apply(uint32_t due, uint32_t slack_ticks) {
+    uint32_t latest = due + slack_ticks;
+    uint32_t differing_bits = due ^ latest;
+
+    if (differing_bits == 0) {
+        return due;
+    }
+
+    // Clearing bits below the highest differing one keeps the time in window
+    uint32_t low_bits_mask = (1UL << (31 - __builtin_clz(differing_bits))) - 1;
+
+    return latest & ~low_bits_mask;
+}
+
+uint32_t time_to_ticks(uint32_t time, uint64_t ticks_per_unit_q32) {
+    // Integer and fractional parts multiplied apart so no product overflows
+    uint64_t integer_ticks = (uint64_t) time * (uint32_t) (ticks_per_unit_q32 >> 32);
+    uint64_t fraction_ticks = (((uint64_t) time * (uint32_t) ticks_per_unit_q32) + (1UL << 31)) >> 32;
+    uint64_t ticks = integer_ticks + fraction_ticks;
+
+    return (ticks > UINT32_MAX) ? UINT32_MAX : ticks;
+}
+
+void timer_expire(soft_timer_t* timer) {
+    queue_remove(timer);
+
+#if SOFT_TIMER_TRACE
+    trace_record(timer->p_scheduler, SOFT_TIMER_TRACE_EXPIRE, timer->id, timer->due);
+#endif
+
+#if SOFT_TIMER_STATS
+    stats_expiry_record(timer);
+#endif
+
+#if EXPIRED_LISTS
+    uint8_t priority = timer->priority;
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+
+    // Still running and out of the expiry queue until its callback is called
+    timer->p_expired = NULL;
+
+    if (p_scheduler->p_expired_head[priority] == NULL) {
+        p_scheduler->p_expired_head[priority] = timer;
+    } else {
+        p_scheduler->p_expired_tail[priority]->p_expired = timer;
+    }
+
+    p_scheduler->p_expired_tail[priority] = timer;
+#else
+    timer_timeout(timer);
+#endif
+}
+
+void timer_timeout(soft_timer_t* timer) {
+    if (timer->repeat && (timer->catch_up != SOFT_TIMER_CATCH_UP_BURST)) {
+        timer_missed_periods_skip(timer);
+    }
+
+    timer_callback_call(timer);
+
+    // Callback may have stopped or restarted this timer
+    if ((timer->state != TIMER_STATE_RUNNING) || queue_contains(timer)) {
+        return;
+    }
+
+    if (timer->repeat) {
+        // Next period counts from the nominal deadline, not from now, to avoid drift
+        timer_queue(timer, timer->due + timer->reload_ticks);
+    } else {
+        timer_stop(timer);
+    }
+}
+
+void timer_missed_periods_skip(soft_timer_t* timer) {
+    uint32_t late_ticks = hard_timer_now(timer->p_scheduler) - timer->due;
+
+    if ((int32_t) late_ticks < (int32_t) timer->reload_ticks) {
+        return;
+    }
+
+    // Division instead of a loop, so the cost does not grow with lateness
+    uint32_t missed_periods = late_ticks / timer->reload_ticks;
+
+    timer->due += missed_periods * timer->reload_ticks;
+
+    if (timer->catch_up == SOFT_TIMER_CATCH_UP_REPORT) {
+        timer->overruns += missed_periods;
+    }
+}
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+
+void ready_queue_dispatch(soft_timer_scheduler_t* p_scheduler, uint8_t priority) {
+    volatile uint16_t* p_tail = &p_scheduler->ready_queue_tail[priority];
+
+    while (*p_tail != p_scheduler->ready_queue_head[priority]) {
+        soft_timer_t* timer = p_scheduler->p_ready_queue[priority][*p_tail];
+
+        *p_tail = (*p_tail + 1) % READY_QUEUE_SIZE;
+        __DMB();
+
+        // Cleared before the callback so a new expiry is queued again
+        timer->ready = false;
+
+        soft_timer_callback_t callback = timer->callback;
+
+        if ((timer->state != TIMER_STATE_FREE) && (callback != NULL)) {
+#if SOFT_TIMER_STATS
+            uint32_t start_cycles = DWT->CYCCNT;
+#endif
+
+            callback(timer);
+
+#if SOFT_TIMER_STATS
+            stats_callback_record(timer, DWT->CYCCNT - start_cycles);
+#endif
+        }
+    }
+}
+
+void timer_callback_call(soft_timer_t* timer) {
+    if (timer->callback == NULL) {
+        return;
+    }
+
+    if (timer->ready) {
+        // Previous timeout still waiting for dispatch, this one is merged
+        if (timer->catch_up == SOFT_TIMER_CATCH_UP_REPORT) {
+            timer->overruns++;
+        }
+
+        return;
+    }
+
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+
+#if SOFT_TIMER_PRIORITY_LEVELS > 1
+    uint8_t priority = timer->priority;
+#else
+    uint8_t priority = 0;
+#endif
+    uint16_t head = p_scheduler->ready_queue_head[priority];
+
+    timer->ready = true;
+    p_scheduler->p_ready_queue[priority][head] = timer;
+    __DMB();
+    p_scheduler->ready_queue_head[priority] = (head + 1) % READY_QUEUE_SIZE;
+
+    soft_timer_dispatch_priority_request(priority);
+}
+
+#else
+
+void timer_callback_call(soft_timer_t* timer) {
+    if (timer->callback != NULL) {
+#if SOFT_TIMER_STATS
+        uint32_t start_cycles = DWT->CYCCNT;
+#endif
+
+        timer->callback(timer);
+
+#if SOFT_TIMER_STATS
+        stats_callback_record(timer, DWT->CYCCNT - start_cycles);
+#endif
+    }
+}
+
+#endif
+
+void timer_start(soft_timer_t* timer, uint32_t start_time) {
+    timer->state = TIMER_STATE_RUNNING;
+    timer_queue(timer, start_time + timer->reload_ticks);
+
+#if SOFT_TIMER_TRACE
+    trace_record(timer->p_scheduler, SOFT_TIMER_TRACE_START, timer->id, timer->due);
+#endif
+}
+
+void timer_restart(soft_timer_t* timer, uint32_t start_time) {
+    queue_remove(timer);
+
+    timer_start(timer, start_time);
+}
+
+soft_timer_status_t timer_start_deadline(soft_timer_t* timer, uint32_t deadline) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    uint32_t now = hard_timer_now(p_scheduler);
+    int32_t ticks_until_deadline = deadline - now;
+
+    // Delayed deadline must still be comparable with current time
+    if ((ticks_until_deadline > 0) &&
+        ((uint32_t) ticks_until_deadline > (MAX_TIMEOUT_TICKS - (uint32_t) timer->slack_ticks))) {
         return SOFT_TIMER_STATUS_INVALID_PARAMETER;
     }
 
-    if (timer->state != TIMER_STATE_RUNNING) {
-        return SOFT_TIMER_STATUS_INVALID_STATE;
+    // Queue is only ordered within half the time range ahead of now
+    if (ticks_until_deadline < 0) {
+        deadline = now;
+    }
+
+    // Countdown starts one period before, so the first timeout is at deadline
+    uint32_t start_time = deadline - timer->reload_ticks;
+
+#if SOFT_TIMER_CONCURRENT_API
+
+    if (!timer_isr_context(p_scheduler)) {
+        command_write(timer, TIMER_COMMAND_START, start_time);
+        timers_update_request(p_scheduler);
+
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+#endif
+
+    if (timer->state != TIMER_STATE_STOPPED) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    timer_start(timer, start_time);
+
+    timers_schedule(p_scheduler);
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+void timer_restart_now(soft_timer_t* timer) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    uint32_t last_deadline = 0;
+    uint32_t next_deadline = 0;
+    bool was_scheduled = queue_next_deadline(p_scheduler, &last_deadline);
+
+    timer_restart(timer, hard_timer_now(p_scheduler));
+
+    // Restarted timer is usually not the next to expire
+    if (!was_scheduled || !queue_next_deadline(p_scheduler, &next_deadline) || (next_deadline != last_deadline)) {
+        timers_schedule(p_scheduler);
+    }
+}
+
+void timers_update(soft_timer_scheduler_t* p_scheduler) {
+#if EXPIRED_LISTS
+    uint32_t now = hard_timer_now(p_scheduler);
+
+    soft_timers_update(p_scheduler, now);
+
+    // Repeating timers long overdue may expire again once queued back
+    while (expired_dispatch(p_scheduler)) {
+        soft_timers_update(p_scheduler, now);
+    }
+#else
+    soft_timers_update(p_scheduler, hard_timer_now(p_scheduler));
+#endif
+
+    timers_schedule(p_scheduler);
+}
+
+#if EXPIRED_LISTS
+
+bool expired_dispatch(soft_timer_scheduler_t* p_scheduler) {
+    bool expired = false;
+
+    for (uint8_t priority = 0; priority < SOFT_TIMER_PRIORITY_LEVELS; priority++) {
+        while (p_scheduler->p_expired_head[priority] != NULL) {
+            soft_timer_t* p_timer = p_scheduler->p_expired_head[priority];
+
+            p_scheduler->p_expired_head[priority] = p_timer->p_expired;
+            expired = true;
+
+            // Higher priority callbacks may have stopped or restarted this timer
+            if ((p_timer->state == TIMER_STATE_RUNNING) && !queue_contains(p_timer)) {
+                timer_timeout(p_timer);
+            }
+        }
+    }
+
+    return expired;
+}
+
+#endif
+
+void timers_update_request(soft_timer_scheduler_t* p_scheduler) {
+#if SOFT_TIMER_CONCURRENT_API
+    // Event register is write only, so this is safe from any context
+    p_scheduler->p_htim->Instance->EGR = TIMER_EVENTSOURCE_CC;
+#else
+    timers_update(p_scheduler);
+#endif
+}
+
+void timers_schedule(soft_timer_scheduler_t* p_scheduler) {
+    uint32_t next_deadline;
+
+    if (!queue_next_deadline(p_scheduler, &next_deadline)) {
+        if (p_scheduler->compare_armed) {
+            hard_timer_compare_stop(p_scheduler);
+            p_scheduler->compare_armed = false;
+
+#if SOFT_TIMER_TRACE
+            trace_record(p_scheduler, SOFT_TIMER_TRACE_IDLE, 0, 0);
+#endif
+        }
+
+        return;
+    }
+
+    // Compare still ahead and not later is kept, an early match only causes
+    // an update with no expired timers, which programs the compare again
+    if (p_scheduler->compare_armed && ((int32_t) (next_deadline - p_scheduler->compare_deadline) >= 0) &&
+        ((int32_t) (p_scheduler->compare_deadline - hard_timer_now(p_scheduler)) > 0)) {
+        return;
+    }
+
+    hard_timer_compare_set(p_scheduler, next_deadline);
+    p_scheduler->compare_deadline = next_deadline;
+    p_scheduler->compare_armed = true;
+
+#if SOFT_TIMER_TRACE
+    trace_record(p_scheduler, SOFT_TIMER_TRACE_COMPARE, 0, next_deadline);
+#endif
+}
+
+#if SOFT_TIMER_CONCURRENT_API || (SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN)
+
+soft_timer_t* timer_from_id(soft_timer_scheduler_t* p_scheduler, uint8_t id) {
+    if (!TIMER_ID_IS_STATIC(id)) {
+        return &p_scheduler->timers[id];
+    }
+
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+    return p_scheduler->p_static_timers[id - SOFT_TIMER_MAX_TIMERS];
+#else
+    return NULL;
+#endif
+}
+
+#endif
+
+#if SOFT_TIMER_CONCURRENT_API
+
+bool timer_isr_context(soft_timer_scheduler_t* p_scheduler) {
+    return __get_IPSR() == p_scheduler->update_ipsr;
+}
+
+void command_post(soft_timer_t* timer, uint8_t command) {
+    command_write(timer, command, hard_timer_now(timer->p_scheduler));
+
+    timers_update_request(timer->p_scheduler);
+}
+
+void command_write(soft_timer_t* timer, uint8_t command, uint32_t time) {
+    timer->command_time = time;
+    timer->command = command;
+
+    // Command must be visible before its pending flag
+    __DMB();
+    command_pending_set(timer->p_scheduler->command_pending, timer);
+}
+
+void period_request_write(soft_timer_t* timer, uint32_t period_ticks, bool immediate) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    uint32_t bit = 1UL << (timer->id % 32);
+
+    // A command still pending was posted first, so it is applied first. One
+    // taken meanwhile is applied before this change in any order.
+    timer->period_late = (p_scheduler->command_pending[timer->id / 32] & bit) != 0;
+
+    // Period and its flag in a single word, never read torn by the interrupt
+    timer->new_period = period_ticks | (immediate ? PERIOD_REQUEST_NOW : 0);
+
+    __DMB();
+    command_pending_set(p_scheduler->period_pending, timer);
+}
+
+void command_pending_set(volatile uint32_t* p_flags, soft_timer_t* timer) {
+    volatile uint32_t* p_word = &p_flags[timer->id / 32];
+    uint32_t bit = 1UL << (timer->id % 32);
+
+#if (__CORTEX_M >= 3U)
+    uint32_t word;
+
+    do {
+        word = __LDREXW(p_word);
+    } while (__STREXW(word | bit, p_word) != 0);
+#else
+    // No exclusive access instructions, interrupts are masked for the write only
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *p_word |= bit;
+    __set_PRIMASK(primask);
+#endif
+}
+
+uint32_t command_pending_take(volatile uint32_t* p_flags, uint8_t word) {
+    volatile uint32_t* p_word = &p_flags[word];
+
+#if (__CORTEX_M >= 3U)
+    uint32_t pending;
+
+    do {
+        pending = __LDREXW(p_word);
+    } while (__STREXW(0, p_word) != 0);
+#else
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t pending = *p_word;
+    *p_word = 0;
+    __set_PRIMASK(primask);
+#endif
+
+    return pending;
+}
+
+void commands_apply(soft_timer_scheduler_t* p_scheduler) {
+    for (uint8_t word = 0; word < COMMAND_PENDING_WORDS; word++) {
+        // Periods are taken first, so a command posted before a taken period is also taken
+        uint32_t periods = command_pending_take(p_scheduler->period_pending, word);
+        uint32_t commands = command_pending_take(p_scheduler->command_pending, word);
+        uint32_t pending = periods | commands;
+
+        // Flags are cleared before commands are read, so a command posted
+        // meanwhile sets its flag again and is applied on the next interrupt
+        __DMB();
+
+        while (pending != 0) {
+            uint32_t bit = pending & -pending;
+            soft_timer_t* p_timer = timer_from_id(p_scheduler, (word * 32) + __builtin_ctz(pending));
+            pending &= pending - 1;
+
+            // Timer in user memory destroyed after posting
+            if (p_timer == NULL) {
+                continue;
+            }
+
+            uint32_t new_period = ((periods & bit) != 0) ? p_timer->new_period : 0;
+            uint32_t period_ticks = new_period & ~PERIOD_REQUEST_NOW;
+            bool immediate = (new_period & PERIOD_REQUEST_NOW) != 0;
+            bool period_late = p_timer->period_late;
+
+            if ((period_ticks != 0) && !period_late && (p_timer->state != TIMER_STATE_FREE)) {
+                timer_period_apply(p_timer, period_ticks, immediate);
+            }
+
+            if ((commands & bit) != 0) {
+                command_apply(p_timer);
+            }
+
+            if ((period_ticks != 0) && period_late && (p_timer->state != TIMER_STATE_FREE)) {
+                timer_period_apply(p_timer, period_ticks, immediate);
+            }
+        }
+    }
+}
+
+void command_apply(soft_timer_t* timer) {
+    if (timer->command == TIMER_COMMAND_START) {
+        if (timer->state == TIMER_STATE_STOPPED) {
+            timer_start(timer, timer->command_time);
+        }
+    } else if (timer->command == TIMER_COMMAND_STOP) {
+        if (timer->state == TIMER_STATE_RUNNING) {
+            timer_stop(timer);
+        }
+    } else if (timer->command == TIMER_COMMAND_RESTART) {
+        if (timer->state != TIMER_STATE_FREE) {
+            timer_restart(timer, timer->command_time);
+        }
+    } else if (timer->state == TIMER_STATE_RUNNING) {
+        timer_restart(timer, timer->command_time);
+    }
+}
+
+#endif
+
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
+
+void queue_insert(soft_timer_t* timer, uint32_t deadline) {
+    timer->deadline = deadline;
+
+    wheel_place(timer);
+}
+
+void queue_remove(soft_timer_t* timer) {
+    if (!queue_contains(timer)) {
+        return;
     }
 
-    timer_stop(timer);
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    uint8_t level = (timer->slot - 1) / WHEEL_SLOTS;
+    uint8_t index = (timer->slot - 1) % WHEEL_SLOTS;
+
+    if (timer->p_next != NULL) {
+        timer->p_next->p_prev = timer->p_prev;
+    }
 
-    uint32_t time_since_last_update_ms = hard_timer_counter_get(mp_htim);
+    if (timer->p_prev != NULL) {
+        timer->p_prev->p_next = timer->p_next;
+    } else {
+        p_scheduler->p_wheel_slots[level][index] = timer->p_next;
 
-    timers_update(time_since_last_update_ms);
+        if (timer->p_next == NULL) {
+            p_scheduler->wheel_pending[level] &= ~(1UL << index);
+        }
+    }
 
-    return SOFT_TIMER_STATUS_SUCCESS;
+    timer->slot = WHEEL_SLOT_NONE;
+    timer->p_prev = NULL;
+    timer->p_next = NULL;
 }
 
-bool soft_timer_is_stopped(soft_timer_t* timer) {
-    return (timer->state == TIMER_STATE_STOPPED);
+bool queue_contains(soft_timer_t* timer) {
+    return timer->slot != WHEEL_SLOT_NONE;
 }
 
-void soft_timer_period_elapsed_callback(void) {
-    uint16_t elapsed_time_ms = hard_timer_reload_get(mp_htim);
+bool queue_next_deadline(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline) {
+    if (wheel_is_empty(p_scheduler)) {
+        return false;
+    }
 
-    timers_update(elapsed_time_ms);
+    *p_deadline = wheel_next_event(p_scheduler);
+
+    return true;
 }
 
-/*****************************************
- * Private Functions Bodies Definitions
- *****************************************/
+void wheel_place(soft_timer_t* timer) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    uint32_t place_at = timer->deadline;
+    uint32_t ticks_ahead = place_at - p_scheduler->wheel_time;
+    uint8_t level = 0;
+
+    if ((int32_t) ticks_ahead <= 0) {
+        // Already expired, placed in the current slot
+        place_at = p_scheduler->wheel_time;
+        ticks_ahead = 0;
+    } else if (ticks_ahead >= WHEEL_RANGE_TICKS) {
+        // Parked in the last slot reachable, placed again once cascaded
+        place_at = p_scheduler->wheel_time + WHEEL_RANGE_TICKS - 1;
+        ticks_ahead = WHEEL_RANGE_TICKS - 1;
+    }
 
-void timer_stop(soft_timer_t* timer) {
-    timer->state = TIMER_STATE_STOPPED;
-    timer->countdown_ms = STOPPED_TIMER_COUNTDOWN_VALUE;
-    timer->repeat = false;
+    while (ticks_ahead >= (1UL << (WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint8_t index = (place_at >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+    soft_timer_t* p_head = p_scheduler->p_wheel_slots[level][index];
+
+    timer->slot = (level * WHEEL_SLOTS) + index + 1;
+    timer->p_prev = NULL;
+    timer->p_next = p_head;
+
+    if (p_head != NULL) {
+        p_head->p_prev = timer;
+    }
+
+    p_scheduler->p_wheel_slots[level][index] = timer;
+    p_scheduler->wheel_pending[level] |= (1UL << index);
+}
+
+void wheel_cascade(soft_timer_scheduler_t* p_scheduler, uint8_t level, uint8_t index) {
+    soft_timer_t* p_timer = p_scheduler->p_wheel_slots[level][index];
+
+    p_scheduler->p_wheel_slots[level][index] = NULL;
+    p_scheduler->wheel_pending[level] &= ~(1UL << index);
+
+    while (p_timer != NULL) {
+        soft_timer_t* p_next = p_timer->p_next;
+
+        wheel_place(p_timer);
+        p_timer = p_next;
+    }
+}
+
+bool wheel_is_empty(soft_timer_scheduler_t* p_scheduler) {
+    for (uint8_t level = 0; level < SOFT_TIMER_WHEEL_LEVELS; level++) {
+        if (p_scheduler->wheel_pending[level] != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t wheel_next_event(soft_timer_scheduler_t* p_scheduler) {
+    uint32_t next_event = p_scheduler->wheel_time + WHEEL_RANGE_TICKS;
+
+    for (uint8_t level = 0; level < SOFT_TIMER_WHEEL_LEVELS; level++) {
+        if (p_scheduler->wheel_pending[level] == 0) {
+            continue;
+        }
+
+        // Current slot of upper levels is already cascaded, so it is a full turn ahead
+        uint8_t skip = (level == 0) ? 0 : 1;
+        uint8_t shift = WHEEL_SLOT_BITS * level;
+        uint8_t first = (((p_scheduler->wheel_time >> shift) + skip) & WHEEL_SLOT_MASK);
+
+        // Rotate so the first slot to be checked is bit 0
+        uint32_t pending = p_scheduler->wheel_pending[level];
+        pending = (pending >> first) | (pending << ((WHEEL_SLOTS - first) & WHEEL_SLOT_MASK));
+
+        uint32_t slots_ahead = __builtin_ctz(pending) + skip;
+        uint32_t event = ((p_scheduler->wheel_time >> shift) + slots_ahead) << shift;
+
+        if ((int32_t) (event - next_event) < 0) {
+            next_event = event;
+        }
+    }
+
+    return next_event;
+}
+
+void soft_timers_update(soft_timer_scheduler_t* p_scheduler, uint32_t now) {
+    while (!wheel_is_empty(p_scheduler)) {
+        uint32_t next_event = wheel_next_event(p_scheduler);
+
+        if ((int32_t) (next_event - now) > 0) {
+            return;
+        }
+
+        p_scheduler->wheel_time = next_event;
+
+        for (uint8_t level = 1; level < SOFT_TIMER_WHEEL_LEVELS; level++) {
+            if ((p_scheduler->wheel_time & ((1UL << (WHEEL_SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+
+            wheel_cascade(p_scheduler, level, (p_scheduler->wheel_time >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK);
+        }
+
+        soft_timer_t** pp_slot = &p_scheduler->p_wheel_slots[0][p_scheduler->wheel_time & WHEEL_SLOT_MASK];
+
+        while (*pp_slot != NULL) {
+            soft_timer_t* p_timer = *pp_slot;
+
+            if ((int32_t) (p_timer->deadline - p_scheduler->wheel_time) <= 0) {
+                timer_expire(p_timer);
+            } else {
+                // Parked timer beyond wheel range
+                queue_remove(p_timer);
+                wheel_place(p_timer);
+            }
+        }
+    }
+
+    p_scheduler->wheel_time = now;
 }
 
-void timer_step(soft_timer_t* timer, uint16_t time_step_ms) {
-    if ((timer->state != TIMER_STATE_RUNNING) || (timer->countdown_ms == 0)) {
+#elif SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN
+
+void queue_insert(soft_timer_t* timer, uint32_t deadline) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+
+    p_scheduler->scan_deadlines[timer->id] = deadline;
+    p_scheduler->scan_queued[timer->id / 32] |= 1UL << (timer->id % 32);
+
+    if (p_scheduler->scan_next_stale) {
         return;
     }
 
-    timer->countdown_ms -= min(timer->countdown_ms, time_step_ms);
+    if (!p_scheduler->scan_next_valid || ((int32_t) (deadline - p_scheduler->scan_next_deadline) < 0)) {
+        p_scheduler->scan_next_deadline = deadline;
+        p_scheduler->scan_next_valid = true;
+    }
+}
 
-    if (timer->countdown_ms != 0) {
+void queue_remove(soft_timer_t* timer) {
+    if (!queue_contains(timer)) {
         return;
     }
 
-    if (timer->callback != NULL) {
-        timer->callback(timer);
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+
+    p_scheduler->scan_queued[timer->id / 32] &= ~(1UL << (timer->id % 32));
+
+    // Only a scan finds the next earliest deadline
+    if (p_scheduler->scan_deadlines[timer->id] == p_scheduler->scan_next_deadline) {
+        p_scheduler->scan_next_stale = true;
     }
+}
 
-    if (timer->repeat) {
-        timer->countdown_ms = timer->reload_ms - 1;
+bool queue_contains(soft_timer_t* timer) {
+    return (timer->p_scheduler->scan_queued[timer->id / 32] & (1UL << (timer->id % 32))) != 0;
+}
+
+bool queue_next_deadline(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline) {
+    if (p_scheduler->scan_next_stale) {
+        p_scheduler->scan_next_valid = scan_earliest(p_scheduler, &p_scheduler->scan_next_deadline);
+        p_scheduler->scan_next_stale = false;
+    }
+
+    *p_deadline = p_scheduler->scan_next_deadline;
+
+    return p_scheduler->scan_next_valid;
+}
+
+bool scan_earliest(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline) {
+    bool found = false;
+
+    for (uint8_t word = 0; word < SCAN_QUEUED_WORDS; word++) {
+        uint32_t queued = p_scheduler->scan_queued[word];
+
+        while (queued != 0) {
+            uint32_t deadline = p_scheduler->scan_deadlines[(word * 32) + __builtin_ctz(queued)];
+            queued &= queued - 1;
+
+            if (!found || ((int32_t) (deadline - *p_deadline) < 0)) {
+                *p_deadline = deadline;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+bool scan_next_deadline_peek(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline) {
+    if (p_scheduler->scan_next_stale) {
+        return scan_earliest(p_scheduler, p_deadline);
+    }
+
+    *p_deadline = p_scheduler->scan_next_deadline;
+
+    return p_scheduler->scan_next_valid;
+}
+
+void soft_timers_update(soft_timer_scheduler_t* p_scheduler, uint32_t now) {
+    bool expired;
+
+    // Repeating timers long overdue may expire again right away
+    do {
+        expired = false;
+
+        for (uint8_t word = 0; word < SCAN_QUEUED_WORDS; word++) {
+            uint32_t queued = p_scheduler->scan_queued[word];
+
+            while (queued != 0) {
+                uint8_t id = (word * 32) + __builtin_ctz(queued);
+                uint32_t bit = queued & -queued;
+                queued &= queued - 1;
+
+                // Callbacks may have stopped timers not yet checked
+                if (((p_scheduler->scan_queued[word] & bit) != 0) &&
+                    ((int32_t) (p_scheduler->scan_deadlines[id] - now) <= 0)) {
+                    timer_expire(timer_from_id(p_scheduler, id));
+                    expired = true;
+                }
+            }
+        }
+    } while (expired);
+}
+
+#else
+
+void queue_insert(soft_timer_t* timer, uint32_t deadline) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    soft_timer_t* p_prev = NULL;
+    soft_timer_t* p_next = p_scheduler->p_queue_head;
+
+    while ((p_next != NULL) && ((int32_t) (p_next->deadline - deadline) <= 0)) {
+        p_prev = p_next;
+        p_next = p_next->p_next;
+    }
+
+    timer->deadline = deadline;
+    timer->p_prev = p_prev;
+    timer->p_next = p_next;
+
+    if (p_next != NULL) {
+        p_next->p_prev = timer;
+    }
+
+    if (p_prev != NULL) {
+        p_prev->p_next = timer;
     } else {
-        timer_stop(timer);
+        p_scheduler->p_queue_head = timer;
+    }
+}
+
+void queue_remove(soft_timer_t* timer) {
+    if (!queue_contains(timer)) {
+        return;
+    }
+
+    if (timer->p_next != NULL) {
+        timer->p_next->p_prev = timer->p_prev;
+    }
+
+    if (timer->p_prev != NULL) {
+        timer->p_prev->p_next = timer->p_next;
+    } else {
+        timer->p_scheduler->p_queue_head = timer->p_next;
     }
+
+    timer->p_prev = NULL;
+    timer->p_next = NULL;
+}
+
+bool queue_contains(soft_timer_t* timer) {
+    return (timer->p_prev != NULL) || (timer->p_scheduler->p_queue_head == timer);
 }
 
-void timers_update(uint32_t time_since_last_update_ms) {
-    uint32_t next_reload_ms = soft_timers_update(time_since_last_update_ms);
+bool queue_next_deadline(soft_timer_scheduler_t* p_scheduler, uint32_t* p_deadline) {
+    if (p_scheduler->p_queue_head == NULL) {
+        return false;
+    }
+
+    *p_deadline = p_scheduler->p_queue_head->deadline;
+
+    return true;
+}
 
-    hard_timer_update(next_reload_ms);
+void soft_timers_update(soft_timer_scheduler_t* p_scheduler, uint32_t now) {
+    while ((p_scheduler->p_queue_head != NULL) && ((int32_t) (p_scheduler->p_queue_head->deadline - now) <= 0)) {
+        timer_expire(p_scheduler->p_queue_head);
+    }
 }
 
-uint32_t soft_timers_update(uint32_t time_since_last_update_ms) {
-    uint32_t time_until_next_timeout_ms = STOPPED_TIMER_COUNTDOWN_VALUE;
+#endif
+
+#if SOFT_TIMER_STATS
 
-    for (uint8_t i = 0; i < SOFT_TIMER_MAX_TIMERS; i++) {
-        timer_step(&m_timers[i], time_since_last_update_ms);
+void stats_expiry_record(soft_timer_t* timer) {
+    soft_timer_scheduler_t* p_scheduler = timer->p_scheduler;
+    uint32_t deadline = slack_apply(timer->due, timer->slack_ticks);
+    int32_t lateness_ticks = hard_timer_now(p_scheduler) - deadline;
 
-        time_until_next_timeout_ms = min(time_until_next_timeout_ms, m_timers[i].countdown_ms);
+    if (lateness_ticks < 0) {
+        lateness_ticks = 0;
     }
 
-    return (time_until_next_timeout_ms == STOPPED_TIMER_COUNTDOWN_VALUE) ?
-           0 : time_until_next_timeout_ms;
+    p_scheduler->stats.expired_count++;
+    p_scheduler->stats.lateness_ticks_total += lateness_ticks;
+    p_scheduler->stats.lateness_ticks_max = max(p_scheduler->stats.lateness_ticks_max, (uint32_t) lateness_ticks);
+    p_scheduler->stats_isr_expired++;
+}
+
+void stats_callback_record(soft_timer_t* timer, uint32_t cycles) {
+    soft_timer_stats_t* p_stats = &timer->p_scheduler->stats;
+
+    timer->cycles_max = max(timer->cycles_max, cycles);
+    p_stats->callback_cycles_max = max(p_stats->callback_cycles_max, cycles);
+}
+
+void stats_isr_record(soft_timer_scheduler_t* p_scheduler, uint32_t cycles) {
+    soft_timer_stats_t* p_stats = &p_scheduler->stats;
+
+    p_stats->isr_count++;
+    p_stats->isr_cycles_last = cycles;
+    p_stats->isr_cycles_max = max(p_stats->isr_cycles_max, cycles);
+    p_stats->isr_cycles_total += cycles;
+    p_stats->isr_expired_max = max(p_stats->isr_expired_max, p_scheduler->stats_isr_expired);
 }
 
-void hard_timer_update(uint32_t timer_reload_ms) {
-    hard_timer_reload_set(mp_htim, timer_reload_ms);
+#endif
+
+#if SOFT_TIMER_TRACE
+
+void trace_record(soft_timer_scheduler_t* p_scheduler, uint8_t type, uint8_t timer_id, uint32_t value) {
+    uint32_t head;
+
+#if (__CORTEX_M >= 3U)
+    do {
+        head = __LDREXW(&m_trace_head);
+
+        if ((head - m_trace_tail) >= SOFT_TIMER_TRACE_SIZE) {
+            __CLREX();
+
+            uint32_t dropped;
 
-    if (timer_reload_ms != 0) {
-        hard_timer_start(mp_htim);
+            do {
+                dropped = __LDREXW(&m_trace_dropped);
+            } while (__STREXW(dropped + 1, &m_trace_dropped) != 0);
+
+            return;
+        }
+    } while (__STREXW(head + 1, &m_trace_head) != 0);
+#else
+    // No exclusive access instructions, interrupts are masked for the reservation only
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    head = m_trace_head;
+    bool full = (head - m_trace_tail) >= SOFT_TIMER_TRACE_SIZE;
+
+    if (full) {
+        m_trace_dropped++;
     } else {
-        hard_timer_stop(mp_htim);
+        m_trace_head = head + 1;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (full) {
+        return;
     }
+#endif
+
+    volatile soft_timer_trace_event_t* p_event = &m_trace_events[head % SOFT_TIMER_TRACE_SIZE];
+
+    p_event->time = hard_timer_now(p_scheduler);
+    p_event->value = value;
+    p_event->timer_id = timer_id;
+    p_event->scheduler = p_scheduler - m_schedulers;
+
+    // Event must be complete before the reader sees its type
+    __DMB();
+    p_event->type = type;
 }
 
-void hard_timer_init(TIM_HandleTypeDef* htim) {
-    uint32_t hclk_frequency = HAL_RCC_GetHCLKFreq();
-    uint32_t prescaler = HZ_TO_KHZ(hclk_frequency) - 1;
+#endif
+
+uint32_t hard_timer_now(soft_timer_scheduler_t* p_scheduler) {
+    uint32_t overflow_ticks;
+    uint32_t pending_ticks;
+    uint32_t counter;
+
+    do {
+        overflow_ticks = p_scheduler->overflow_ticks;
+        pending_ticks = 0;
+        counter = hard_timer_counter_get(p_scheduler);
+
+        // Counter is read again so it is known to be after the overflow
+        if (hard_timer_overflow_pending(p_scheduler)) {
+            pending_ticks = p_scheduler->counter_max + 1;
+            counter = hard_timer_counter_get(p_scheduler);
+        }
+    } while (overflow_ticks != p_scheduler->overflow_ticks);
+
+    return p_scheduler->time_offset_ticks + overflow_ticks + pending_ticks + counter;
+}
+
+#if SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_LPTIM
+
+void hard_timer_init(soft_timer_scheduler_t* p_scheduler, uint32_t tick_frequency_hz) {
+    soft_timer_handle_t* hlptim = p_scheduler->p_htim;
+
+    // Counter clock and prescaler are given by the LPTIM configuration
+    p_scheduler->prescaler = 0;
+    p_scheduler->tick_frequency_hz = max(tick_frequency_hz, 1);
+    p_scheduler->clock_hz = p_scheduler->tick_frequency_hz;
+    p_scheduler->clock_divider = 1;
+    p_scheduler->error_ppm = 0;
 
-    if (prescaler > PRESCALER_MAX_VALUE) {
-        presc_adjust(hclk_frequency, &prescaler);
+    // Interrupt enable register may only be written while disabled
+    __HAL_LPTIM_DISABLE(hlptim);
+    __HAL_LPTIM_ENABLE_IT(hlptim, LPTIM_IT_CMPM | LPTIM_IT_ARRM);
+    __HAL_LPTIM_ENABLE(hlptim);
+
+    __HAL_LPTIM_CLEAR_FLAG(hlptim, LPTIM_FLAG_ARROK);
+    __HAL_LPTIM_AUTORELOAD_SET(hlptim, p_scheduler->counter_max);
+
+    while (__HAL_LPTIM_GET_FLAG(hlptim, LPTIM_FLAG_ARROK) == RESET) {
     }
 
-    __HAL_TIM_SET_PRESCALER(htim, prescaler);
-    __HAL_TIM_SET_AUTORELOAD(htim, m_max_reload_ms);
-    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+    __HAL_LPTIM_CLEAR_FLAG(hlptim, LPTIM_FLAG_ARRM | LPTIM_FLAG_CMPM);
+    __HAL_LPTIM_START_CONTINUOUS(hlptim);
+}
+
+uint32_t hard_timer_counter_get(soft_timer_scheduler_t* p_scheduler) {
+    soft_timer_handle_t* hlptim = p_scheduler->p_htim;
+    uint32_t counter;
+
+    // Counter is asynchronous, only two equal consecutive reads are reliable
+    do {
+        counter = hlptim->Instance->CNT;
+    } while (counter != hlptim->Instance->CNT);
+
+    // Overflow is flagged when counter matches reload value, not when it wraps
+    return (counter + 1) & p_scheduler->counter_max;
+}
+
+bool hard_timer_overflow_pending(soft_timer_scheduler_t* p_scheduler) {
+    return __HAL_LPTIM_GET_FLAG(p_scheduler->p_htim, LPTIM_FLAG_ARRM) != RESET;
+}
+
+uint32_t hard_timer_events_take(soft_timer_scheduler_t* p_scheduler) {
+    LPTIM_TypeDef* instance = p_scheduler->p_htim->Instance;
+    uint32_t flags = instance->ISR & instance->IER & (LPTIM_FLAG_ARRM | LPTIM_FLAG_CMPM);
+
+    __HAL_LPTIM_CLEAR_FLAG(p_scheduler->p_htim, flags);
+
+    return (((flags & LPTIM_FLAG_ARRM) != 0) ? HARD_TIMER_EVENT_OVERFLOW : 0) |
+           (((flags & LPTIM_FLAG_CMPM) != 0) ? HARD_TIMER_EVENT_COMPARE : 0);
+}
+
+void hard_timer_compare_set(soft_timer_scheduler_t* p_scheduler, uint32_t deadline) {
+    soft_timer_handle_t* hlptim = p_scheduler->p_htim;
+
+    if (p_scheduler->compare_write_pending) {
+        while (__HAL_LPTIM_GET_FLAG(hlptim, LPTIM_FLAG_CMPOK) == RESET) {
+        }
+    }
+
+    uint32_t now = hard_timer_now(p_scheduler);
+
+    // Compare match can not be generated by software
+    if ((int32_t) (deadline - now) < LPTIM_COMPARE_MIN_TICKS) {
+        deadline = now + LPTIM_COMPARE_MIN_TICKS;
+    }
+
+    __HAL_LPTIM_CLEAR_FLAG(hlptim, LPTIM_FLAG_CMPOK);
+    __HAL_LPTIM_COMPARE_SET(hlptim, (deadline - p_scheduler->time_offset_ticks - 1) & p_scheduler->counter_max);
+    p_scheduler->compare_write_pending = true;
+}
+
+void hard_timer_compare_stop(soft_timer_scheduler_t* p_scheduler) {
+    // Interrupt enable register can not be written while running, a stale
+    // compare match only causes an update with no expired timers
+    UNUSED(p_scheduler);
+}
+
+#elif SOFT_TIMER_HARDWARE == SOFT_TIMER_HARDWARE_HOST
+
+void hard_timer_init(soft_timer_scheduler_t* p_scheduler, uint32_t tick_frequency_hz) {
+    soft_timer_handle_t* htim = p_scheduler->p_htim;
+
+    // Simulated ticks have no clock behind them, any frequency is exact
+    p_scheduler->prescaler = 0;
+    p_scheduler->tick_frequency_hz = max(tick_frequency_hz, 1);
+    p_scheduler->clock_hz = p_scheduler->tick_frequency_hz;
+    p_scheduler->clock_divider = 1;
+    p_scheduler->error_ppm = 0;
+
+    htim->counter = 0;
+    htim->compare = 0;
+    htim->compare_enabled = false;
+    htim->compare_pending = false;
+    htim->overflow_pending = false;
+}
+
+uint32_t hard_timer_counter_get(soft_timer_scheduler_t* p_scheduler) {
+    return p_scheduler->p_htim->counter;
+}
+
+bool hard_timer_overflow_pending(soft_timer_scheduler_t* p_scheduler) {
+    return p_scheduler->p_htim->overflow_pending;
+}
+
+void hard_timer_compare_set(soft_timer_scheduler_t* p_scheduler, uint32_t deadline) {
+    soft_timer_handle_t* htim = p_scheduler->p_htim;
+
+    htim->compare = (deadline - p_scheduler->time_offset_ticks) & p_scheduler->counter_max;
+    htim->compare_enabled = true;
+    htim->compare_pending = (int32_t) (deadline - hard_timer_now(p_scheduler)) <= 0;
+}
+
+void hard_timer_compare_stop(soft_timer_scheduler_t* p_scheduler) {
+    p_scheduler->p_htim->compare_enabled = false;
+    p_scheduler->p_htim->compare_pending = false;
+}
+
+void host_interrupts_run(soft_timer_scheduler_t* p_scheduler) {
+    soft_timer_handle_t* htim = p_scheduler->p_htim;
+
+    while (htim->compare_pending || htim->overflow_pending) {
+        if (htim->compare_pending) {
+            htim->compare_pending = false;
+            soft_timer_scheduler_output_compare_callback(p_scheduler);
+        }
+
+        if (htim->overflow_pending) {
+            htim->overflow_pending = false;
+            soft_timer_scheduler_period_elapsed_callback(p_scheduler);
+        }
+    }
 }
 
-void hard_timer_start(TIM_HandleTypeDef* htim) {
-    __HAL_TIM_SET_COUNTER(htim, 0);
+#else
+
+void hard_timer_init(soft_timer_scheduler_t* p_scheduler, uint32_t tick_frequency_hz) {
+    soft_timer_handle_t* htim = p_scheduler->p_htim;
+    uint32_t clock_hz = hard_timer_clock_get(htim);
+    uint32_t requested_hz = max(tick_frequency_hz, 1);
+
+    // Nearest divider the prescaler can give, it divides by its value plus one
+    uint64_t divider = ((uint64_t) clock_hz + (requested_hz / 2)) / requested_hz;
+    divider = min(max(divider, 1), PRESCALER_MAX_VALUE + 1);
+
+    uint64_t requested_cycles = divider * requested_hz;
+    int64_t actual_ppm = (((uint64_t) clock_hz * PPM) + (requested_cycles / 2)) / requested_cycles;
+    uint32_t prescaler = divider - 1;
+
+    p_scheduler->prescaler = prescaler;
+    p_scheduler->clock_hz = clock_hz;
+    p_scheduler->clock_divider = divider;
+    p_scheduler->tick_frequency_hz = (clock_hz + (divider / 2)) / divider;
+
+    // Divider clamped for a very low frequency may leave a deviation beyond the field range
+    p_scheduler->error_ppm = min(actual_ppm - PPM, INT32_MAX);
+
+    __HAL_TIM_SET_PRESCALER(htim, prescaler);
+    __HAL_TIM_SET_AUTORELOAD(htim, p_scheduler->counter_max);
+
+    // Update event loads the prescaler and resets the counter
+    HAL_TIM_GenerateEvent(htim, TIM_EVENTSOURCE_UPDATE);
+    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE | TIMER_FLAG_CC);
+
+#if SOFT_TIMER_CONCURRENT_API
+    // Always enabled, as commands are applied by the compare interrupt
+    __HAL_TIM_ENABLE_IT(htim, TIMER_IT_CC);
+#endif
+
     HAL_TIM_Base_Start_IT(htim);
 }
 
-void hard_timer_stop(TIM_HandleTypeDef* htim) {
-    HAL_TIM_Base_Stop_IT(htim);
-    __HAL_TIM_SET_COUNTER(htim, 0);
+uint32_t hard_timer_counter_get(soft_timer_scheduler_t* p_scheduler) {
+    return __HAL_TIM_GET_COUNTER(p_scheduler->p_htim);
 }
 
-uint32_t hard_timer_reload_get(TIM_HandleTypeDef* htim) {
-    return __HAL_TIM_GET_AUTORELOAD(htim);
+bool hard_timer_overflow_pending(soft_timer_scheduler_t* p_scheduler) {
+    return __HAL_TIM_GET_FLAG(p_scheduler->p_htim, TIM_FLAG_UPDATE) != RESET;
 }
 
-uint32_t hard_timer_counter_get(TIM_HandleTypeDef* htim) {
-    return __HAL_TIM_GET_COUNTER(htim);
+uint32_t hard_timer_events_take(soft_timer_scheduler_t* p_scheduler) {
+    TIM_TypeDef* instance = p_scheduler->p_htim->Instance;
+
+    // Interrupt enable bits share the positions of their flags
+    uint32_t flags = instance->SR & instance->DIER & (TIM_FLAG_UPDATE | TIMER_FLAG_CC);
+
+    __HAL_TIM_CLEAR_FLAG(p_scheduler->p_htim, flags);
+
+    return (((flags & TIM_FLAG_UPDATE) != 0) ? HARD_TIMER_EVENT_OVERFLOW : 0) |
+           (((flags & TIMER_FLAG_CC) != 0) ? HARD_TIMER_EVENT_COMPARE : 0);
+}
+
+void hard_timer_compare_set(soft_timer_scheduler_t* p_scheduler, uint32_t deadline) {
+    soft_timer_handle_t* htim = p_scheduler->p_htim;
+    uint32_t compare = (deadline - p_scheduler->time_offset_ticks) & p_scheduler->counter_max;
+
+    __HAL_TIM_SET_COMPARE(htim, SOFT_TIMER_TIM_CHANNEL, compare);
+    __HAL_TIM_CLEAR_FLAG(htim, TIMER_FLAG_CC);
+    __HAL_TIM_ENABLE_IT(htim, TIMER_IT_CC);
+
+    // Counter may have passed the compare value before it was written
+    if ((int32_t) (deadline - hard_timer_now(p_scheduler)) <= 0) {
+        htim->Instance->EGR = TIMER_EVENTSOURCE_CC;
+    }
 }
 
-void hard_timer_reload_set(TIM_HandleTypeDef* htim, uint32_t reload_ms) {
-    reload_ms *= m_reload_adjust;
-    reload_ms = min(reload_ms, m_max_reload_ms);
+void hard_timer_compare_stop(soft_timer_scheduler_t* p_scheduler) {
+#if SOFT_TIMER_CONCURRENT_API
+    // Compare interrupt must be kept enabled to apply posted commands,
+    // a compare match on each counter wrap only causes an empty update
+    UNUSED(p_scheduler);
+#else
+    soft_timer_handle_t* htim = p_scheduler->p_htim;
 
-    __HAL_TIM_SET_AUTORELOAD(htim, reload_ms);
+    __HAL_TIM_DISABLE_IT(htim, TIMER_IT_CC);
+    __HAL_TIM_CLEAR_FLAG(htim, TIMER_FLAG_CC);
+#endif
 }
 
 TIM_TypeDef* hard_timer_get_instance(TIM_HandleTypeDef* htim) {
     return htim->Instance;
 }
 
-void presc_adjust(uint32_t hclk_frequency, uint32_t* prescaler) {
-    for (uint32_t i = 0xFFFF; (hclk_frequency % i) == 0; i--) {
-        if ((hclk_frequency % i) == 0) {
-            (*prescaler) = i - 1;
-            m_reload_adjust = (float) hclk_frequency / (i * 1000);
-            m_max_reload_ms /= m_reload_adjust;
+bool trigger_channel_is_valid(uint32_t channel) {
+    return ((channel <= TIM_CHANNEL_4) && ((channel & 0x3U) == 0)) || (channel == TIM_CHANNEL_ALL);
+}
 
-            return;
-        }
+uint64_t trigger_cycles_get(soft_timer_scheduler_t* p_scheduler, soft_timer_handle_t* htim_trigger,
+                            uint32_t period_ticks) {
+    uint64_t scheduler_cycles = (uint64_t) period_ticks * p_scheduler->clock_divider;
+    uint32_t scheduler_clock_hz = p_scheduler->clock_hz;
+    uint32_t trigger_clock_hz = hard_timer_clock_get(htim_trigger);
+
+    if (trigger_clock_hz == scheduler_clock_hz) {
+        return scheduler_cycles;
+    }
+
+    // Split so neither product overflows, the remainder is below the scheduler clock
+    uint64_t whole = (scheduler_cycles / scheduler_clock_hz) * trigger_clock_hz;
+    uint64_t part = (scheduler_cycles % scheduler_clock_hz) * trigger_clock_hz;
+
+    return whole + ((part + (scheduler_clock_hz / 2)) / scheduler_clock_hz);
+}
+
+uint32_t hard_timer_clock_get(soft_timer_handle_t* htim) {
+    uint32_t hclk_frequency = HAL_RCC_GetHCLKFreq();
+    uint32_t pclk_frequency = HAL_RCC_GetPCLK1Freq();
+
+#if defined(APB2PERIPH_BASE)
+    // Timers are only on APB buses, with APB2 above APB1
+    if ((uint32_t) htim->Instance >= APB2PERIPH_BASE) {
+        pclk_frequency = HAL_RCC_GetPCLK2Freq();
     }
+#else
+    UNUSED(htim);
+#endif
+
+    return (pclk_frequency == hclk_frequency) ? pclk_frequency : (pclk_frequency * 2);
 }
+
+#endif
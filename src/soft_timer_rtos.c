@@ -0,0 +1,235 @@
+/**
+ * @file soft_timer_rtos.c
+ *
+ * @brief Software timer adapter for FreeRTOS.
+ */
+
+#include "soft_timer_rtos.h"
+
+#if SOFT_TIMER_RTOS
+
+#if !SOFT_TIMER_DEFERRED_CALLBACKS
+#error SOFT_TIMER_RTOS requires SOFT_TIMER_DEFERRED_CALLBACKS, callbacks are called from the service tasks.
+#endif
+
+/*****************************************
+ * Private Functions Prototypes
+ *****************************************/
+
+/**
+ * @brief Service task, dispatches one priority level when notified.
+ *
+ * @param p_parameters Priority level, cast to a pointer.
+ */
+static void service_task(void* p_parameters);
+
+/**
+ * @brief Timer callback that notifies the task given by the timer context.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void notify_callback(soft_timer_t* timer);
+
+/*****************************************
+ * Private Variables
+ *****************************************/
+
+/**
+ * @brief Service task of each priority level.
+ */
+static TaskHandle_t m_service_tasks[SOFT_TIMER_PRIORITY_LEVELS];
+
+/*****************************************
+ * Public Functions Bodies Definitions
+ *****************************************/
+
+soft_timer_status_t soft_timer_rtos_init(UBaseType_t priority) {
+    if (m_service_tasks[0] != NULL) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    for (uint8_t i = 0; i < SOFT_TIMER_PRIORITY_LEVELS; i++) {
+        UBaseType_t task_priority = priority + (SOFT_TIMER_PRIORITY_LEVELS - 1 - i);
+
+        if (xTaskCreate(service_task, "soft_timer", SOFT_TIMER_RTOS_STACK_SIZE, (void*) (uintptr_t) i, task_priority,
+                        &m_service_tasks[i]) != pdPASS) {
+            for (uint8_t j = 0; j < i; j++) {
+                vTaskDelete(m_service_tasks[j]);
+                m_service_tasks[j] = NULL;
+            }
+
+            m_service_tasks[i] = NULL;
+
+            return SOFT_TIMER_STATUS_INVALID_STATE;
+        }
+    }
+
+    return SOFT_TIMER_STATUS_SUCCESS;
+}
+
+void soft_timer_rtos_lock(void) {
+    taskENTER_CRITICAL();
+}
+
+void soft_timer_rtos_unlock(void) {
+    taskEXIT_CRITICAL();
+}
+
+soft_timer_t* soft_timer_rtos_create(void) {
+    soft_timer_rtos_lock();
+    soft_timer_t* timer = soft_timer_create();
+    soft_timer_rtos_unlock();
+
+    return timer;
+}
+
+void soft_timer_rtos_destroy(soft_timer_t** timer) {
+    soft_timer_rtos_lock();
+    soft_timer_destroy(timer);
+    soft_timer_rtos_unlock();
+}
+
+soft_timer_status_t soft_timer_rtos_set(soft_timer_t* timer, soft_timer_callback_t callback, uint32_t reload_ms,
+                                        bool repeat) {
+    soft_timer_rtos_lock();
+    soft_timer_status_t status = soft_timer_set(timer, callback, reload_ms, repeat);
+    soft_timer_rtos_unlock();
+
+    return status;
+}
+
+soft_timer_status_t soft_timer_rtos_set_notify(soft_timer_t* timer, uint32_t reload_ms, bool repeat,
+                                               soft_timer_rtos_notify_t* p_notify) {
+    if ((p_notify == NULL) || (p_notify->task == NULL)) {
+        return SOFT_TIMER_STATUS_INVALID_PARAMETER;
+    }
+
+    soft_timer_rtos_lock();
+    soft_timer_status_t status = soft_timer_set(timer, notify_callback, reload_ms, repeat);
+
+    if (status == SOFT_TIMER_STATUS_SUCCESS) {
+        status = soft_timer_context_set(timer, p_notify);
+    }
+
+    soft_timer_rtos_unlock();
+
+    return status;
+}
+
+soft_timer_status_t soft_timer_rtos_start(soft_timer_t* timer) {
+    soft_timer_rtos_lock();
+    soft_timer_status_t status = soft_timer_start(timer);
+    soft_timer_rtos_unlock();
+
+    return status;
+}
+
+soft_timer_status_t soft_timer_rtos_stop(soft_timer_t* timer) {
+    soft_timer_rtos_lock();
+    soft_timer_status_t status = soft_timer_stop(timer);
+    soft_timer_rtos_unlock();
+
+    return status;
+}
+
+soft_timer_status_t soft_timer_rtos_restart(soft_timer_t* timer) {
+    soft_timer_rtos_lock();
+    soft_timer_status_t status = soft_timer_restart(timer);
+    soft_timer_rtos_unlock();
+
+    return status;
+}
+
+soft_timer_status_t soft_timer_rtos_delay_ms(uint32_t delay_ms) {
+    if (delay_ms == 0) {
+        return SOFT_TIMER_STATUS_SUCCESS;
+    }
+
+    soft_timer_t* timer = soft_timer_rtos_create();
+
+    if (timer == NULL) {
+        return SOFT_TIMER_STATUS_INVALID_STATE;
+    }
+
+    soft_timer_rtos_notify_t notify = {
+        .task = xTaskGetCurrentTaskHandle(),
+        .bits = SOFT_TIMER_RTOS_DELAY_BIT,
+    };
+
+    soft_timer_status_t status = soft_timer_rtos_set_notify(timer, delay_ms, false, &notify);
+
+    if (status == SOFT_TIMER_STATUS_SUCCESS) {
+        status = soft_timer_rtos_start(timer);
+    }
+
+    if (status == SOFT_TIMER_STATUS_SUCCESS) {
+        uint32_t other_bits = 0;
+        uint32_t value;
+
+        do {
+            xTaskNotifyWait(0, SOFT_TIMER_RTOS_DELAY_BIT, &value, portMAX_DELAY);
+            other_bits |= value & ~SOFT_TIMER_RTOS_DELAY_BIT;
+        } while ((value & SOFT_TIMER_RTOS_DELAY_BIT) == 0);
+
+        // Waiting consumed the pending state of notifications meant for the task
+        if (other_bits != 0) {
+            xTaskNotify(notify.task, other_bits, eSetBits);
+        }
+    }
+
+    soft_timer_rtos_destroy(&timer);
+
+    return status;
+}
+
+TickType_t soft_timer_rtos_idle_time_limit(TickType_t expected_idle_time) {
+    soft_timer_rtos_lock();
+    uint32_t next_expiry_ticks = soft_timer_next_expiry_ticks();
+    uint32_t tick_frequency_hz = soft_timer_tick_frequency_get();
+    soft_timer_rtos_unlock();
+
+    if ((next_expiry_ticks == SOFT_TIMER_NO_EXPIRY) || (tick_frequency_hz == 0)) {
+        return expected_idle_time;
+    }
+
+    uint64_t idle_time = ((uint64_t) next_expiry_ticks * configTICK_RATE_HZ) / tick_frequency_hz;
+
+    return (idle_time < expected_idle_time) ? (TickType_t) idle_time : expected_idle_time;
+}
+
+void soft_timer_dispatch_priority_request(uint8_t priority) {
+    TaskHandle_t task = m_service_tasks[priority];
+
+    if (task == NULL) {
+        return;
+    }
+
+    if (xPortIsInsideInterrupt()) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    } else {
+        xTaskNotifyGive(task);
+    }
+}
+
+/*****************************************
+ * Private Functions Bodies Definitions
+ *****************************************/
+
+void service_task(void* p_parameters) {
+    uint8_t priority = (uint8_t) (uintptr_t) p_parameters;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        soft_timer_dispatch_priority(priority);
+    }
+}
+
+void notify_callback(soft_timer_t* timer) {
+    soft_timer_rtos_notify_t* p_notify = soft_timer_context_get(timer);
+
+    xTaskNotify(p_notify->task, p_notify->bits, eSetBits);
+}
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * @file soft_timer_bench.c
+ *
+ * @brief Scheduler benchmark on the host backend.
+ *
+ * @note Measures start and stop cost, update cost and lateness versus the
+ *       number of running timers, for the backend given at build time.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "soft_timer.h"
+
+/*****************************************
+ * Private Constants
+ *****************************************/
+
+#define BENCH_SEED           12345
+#define BENCH_COUNTER        0xFFFF
+#define BENCH_WARMUP_TICKS   5000
+#define BENCH_UPDATE_TICKS   200000
+#define BENCH_START_STOPS    20000
+#define BENCH_PERIOD_MIN     50
+#define BENCH_PERIOD_MAX     1049
+#define BENCH_NS_PER_S       1000000000ULL
+#define BENCH_CALIBRATIONS   1000
+
+#if SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_WHEEL
+#define BENCH_BACKEND_NAME "wheel"
+#elif SOFT_TIMER_BACKEND == SOFT_TIMER_BACKEND_SCAN
+#define BENCH_BACKEND_NAME "scan"
+#else
+#define BENCH_BACKEND_NAME "list"
+#endif
+
+/*****************************************
+ * Private Types
+ *****************************************/
+
+/**
+ * @brief Benchmark state of one timer.
+ */
+typedef struct bench_timer {
+    soft_timer_t* p_timer; /**< Timer under benchmark. */
+    uint32_t      period;  /**< Reload value in ticks. */
+    uint32_t      due;     /**< Expected timeout time. */
+} bench_timer_t;
+
+/*****************************************
+ * Private Functions Prototypes
+ *****************************************/
+
+/**
+ * @brief Records lateness of a timeout.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void bench_callback(soft_timer_t* timer);
+
+/**
+ * @brief Runs all measurements with given number of running timers.
+ *
+ * @param count Number of timers.
+ */
+static void bench_run(uint16_t count);
+
+/**
+ * @brief Sets and starts a timer with its period, expecting its timeout.
+ *
+ * @param p_bench Pointer to timer state.
+ */
+static void bench_timer_start(bench_timer_t* p_bench);
+
+/**
+ * @brief Measures overhead of reading the clock twice.
+ *
+ * @return Overhead in nanoseconds.
+ */
+static uint64_t clock_overhead_get(void);
+
+/**
+ * @brief Gets monotonic wall clock time.
+ *
+ * @return Time in nanoseconds.
+ */
+static uint64_t clock_ns(void);
+
+/*****************************************
+ * Private Variables
+ *****************************************/
+
+static soft_timer_host_timer_t m_host_timer;
+static bench_timer_t m_timers[SOFT_TIMER_MAX_TIMERS];
+static const uint16_t m_timer_counts[] = {1, 8, 32, 128};
+static uint64_t m_clock_overhead_ns;
+
+static uint64_t m_timeouts;
+static uint64_t m_updates;
+static uint64_t m_lateness_sum;
+static uint32_t m_lateness_max;
+static uint32_t m_last_timeout_time;
+
+/*****************************************
+ * Main Function
+ *****************************************/
+
+int main(void) {
+    srand(BENCH_SEED);
+    soft_timer_init(&m_host_timer, BENCH_COUNTER);
+    m_clock_overhead_ns = clock_overhead_get();
+
+    printf("%-8s %8s %10s %10s %11s %12s %10s %10s\n", "backend", "timers", "start_ns", "stop_ns", "update_ns",
+           "timeout_ns", "late_max", "late_mean");
+
+    for (uint8_t i = 0; i < (sizeof(m_timer_counts) / sizeof(m_timer_counts[0])); i++) {
+        if (m_timer_counts[i] <= SOFT_TIMER_MAX_TIMERS) {
+            bench_run(m_timer_counts[i]);
+        }
+    }
+
+    return (m_lateness_max == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*****************************************
+ * Private Functions Bodies Definitions
+ *****************************************/
+
+void bench_callback(soft_timer_t* timer) {
+    bench_timer_t* p_bench = soft_timer_context_get(timer);
+    uint32_t now = soft_timer_now();
+    uint32_t lateness = now - p_bench->due;
+
+    // Timeouts on the same tick are handled by a single update
+    if ((m_timeouts == 0) || (now != m_last_timeout_time)) {
+        m_updates++;
+    }
+
+    m_timeouts++;
+    m_last_timeout_time = now;
+    m_lateness_sum += lateness;
+
+    if (lateness > m_lateness_max) {
+        m_lateness_max = lateness;
+    }
+
+    p_bench->due += p_bench->period;
+}
+
+void bench_run(uint16_t count) {
+    uint64_t start_ns = 0;
+    uint64_t stop_ns = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        m_timers[i].p_timer = soft_timer_create();
+        m_timers[i].period = BENCH_PERIOD_MIN + (rand() % (BENCH_PERIOD_MAX - BENCH_PERIOD_MIN + 1));
+        soft_timer_context_set(m_timers[i].p_timer, &m_timers[i]);
+        bench_timer_start(&m_timers[i]);
+    }
+
+    soft_timer_host_advance(&m_host_timer, BENCH_WARMUP_TICKS);
+
+    // Stopping clears the repeat setting, so the timer is set again untimed
+    for (uint32_t i = 0; i < BENCH_START_STOPS; i++) {
+        bench_timer_t* p_bench = &m_timers[rand() % count];
+
+        uint64_t before_ns = clock_ns();
+        soft_timer_stop(p_bench->p_timer);
+        stop_ns += clock_ns() - before_ns;
+
+        soft_timer_set_ticks(p_bench->p_timer, bench_callback, p_bench->period, true);
+        p_bench->due = soft_timer_now() + p_bench->period;
+
+        before_ns = clock_ns();
+        soft_timer_start(p_bench->p_timer);
+        start_ns += clock_ns() - before_ns;
+
+        soft_timer_host_advance(&m_host_timer, rand() % 4);
+    }
+
+    m_timeouts = 0;
+    m_updates = 0;
+    m_lateness_sum = 0;
+
+    uint64_t before_ns = clock_ns();
+    soft_timer_host_advance(&m_host_timer, BENCH_UPDATE_TICKS);
+    uint64_t update_ns = clock_ns() - before_ns;
+
+    uint64_t timeouts = (m_timeouts > 0) ? m_timeouts : 1;
+    uint64_t updates = (m_updates > 0) ? m_updates : 1;
+    uint64_t overhead_ns = m_clock_overhead_ns * BENCH_START_STOPS;
+
+    printf("%-8s %8u %10.1f %10.1f %11.1f %12.1f %10lu %10.3f\n", BENCH_BACKEND_NAME, count,
+           (double) ((start_ns > overhead_ns) ? (start_ns - overhead_ns) : 0) / BENCH_START_STOPS,
+           (double) ((stop_ns > overhead_ns) ? (stop_ns - overhead_ns) : 0) / BENCH_START_STOPS,
+           (double) update_ns / updates, (double) update_ns / timeouts, (unsigned long) m_lateness_max,
+           (double) m_lateness_sum / timeouts);
+
+    // Only stopped timers are destroyed
+    for (uint16_t i = 0; i < count; i++) {
+        soft_timer_stop(m_timers[i].p_timer);
+        soft_timer_destroy(&m_timers[i].p_timer);
+    }
+}
+
+void bench_timer_start(bench_timer_t* p_bench) {
+    soft_timer_set_ticks(p_bench->p_timer, bench_callback, p_bench->period, true);
+    p_bench->due = soft_timer_now() + p_bench->period;
+    soft_timer_start(p_bench->p_timer);
+}
+
+uint64_t clock_overhead_get(void) {
+    uint64_t total_ns = 0;
+
+    for (uint32_t i = 0; i < BENCH_CALIBRATIONS; i++) {
+        uint64_t before_ns = clock_ns();
+        total_ns += clock_ns() - before_ns;
+    }
+
+    return total_ns / BENCH_CALIBRATIONS;
+}
+
+uint64_t clock_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * BENCH_NS_PER_S) + (uint64_t) now.tv_nsec;
+}
@@ -0,0 +1,548 @@
+/**
+ * @file soft_timer_test.c
+ *
+ * @brief Randomized test of the scheduler against a reference model, on the host backend.
+ *
+ * @note Built for each backend and configuration in the Makefile, so deferred
+ *       callbacks, priority levels, packed timers and timers in user memory
+ *       are checked too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "soft_timer.h"
+
+/*****************************************
+ * Private Constants
+ *****************************************/
+
+#define TEST_TIMERS         (SOFT_TIMER_MAX_TIMERS + SOFT_TIMER_MAX_STATIC_TIMERS)
+#define TEST_STEPS          50000
+#define TEST_SEED           12345
+#define TEST_COUNTER        0xFFFF
+#define TEST_SLACK_MAX      64
+#define TEST_START_LATE_MAX 20
+#define TEST_STATIC_TICKS   10
+#define TEST_GARBAGE        0xA5
+#define TEST_CATCH_UP_TICKS 10
+#define TEST_SLEEP_TICKS    35
+
+// Packed timers keep reload values in 16 bits, others span many counter periods
+#if SOFT_TIMER_PACKED
+#define TEST_RELOAD_MAX 0xFFFF
+#else
+#define TEST_RELOAD_MAX 70000
+#endif
+
+/*****************************************
+ * Private Types
+ *****************************************/
+
+/**
+ * @brief Expected state of one timer.
+ */
+typedef struct model_timer {
+    soft_timer_t* p_timer;  /**< Timer under test. */
+    bool          running;  /**< Timer expected to be running. */
+    bool          repeat;   /**< Timer restarts after timeout. */
+    bool          expired;  /**< Timed out, callback waiting for dispatch. */
+    uint8_t       priority; /**< Callback priority level. */
+    uint32_t      reload;   /**< Reload value in ticks. */
+    uint32_t      slack;    /**< Maximum timeout delay in ticks. */
+    uint32_t      due;      /**< Expected nominal timeout time, without slack. */
+    uint32_t      called;   /**< Time of the last callback. */
+} model_timer_t;
+
+/*****************************************
+ * Private Functions Prototypes
+ *****************************************/
+
+/**
+ * @brief Checks a timeout against the model.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void test_callback(soft_timer_t* timer);
+
+/**
+ * @brief Creates timer under test, in user memory past the pool size.
+ *
+ * @param index Index of the timer in the model.
+ *
+ * @return Pointer to created timer, NULL if not created.
+ */
+static soft_timer_t* test_timer_create(uint16_t index);
+
+/**
+ * @brief Sets and starts a stopped timer in one of the ways it may be started.
+ *
+ * @param p_model Timer to be started.
+ */
+static void model_start(model_timer_t* p_model);
+
+/**
+ * @brief Gets the time at which the scheduler times a timer out.
+ *
+ * @note Latest tick of the slack window with most low bits cleared, the
+ *       power of two alignment of @ref soft_timer_set_ex.
+ *
+ * @param p_model Timer model.
+ *
+ * @return Expected timeout time.
+ */
+static uint32_t model_deadline(const model_timer_t* p_model);
+
+/**
+ * @brief Takes timeouts up to now in the model, as deferred callbacks run after them.
+ */
+static void model_expire(void);
+
+/**
+ * @brief Checks that no running timer missed its timeout and stopped states match.
+ */
+static void model_check(void);
+
+/**
+ * @brief Counts timeouts of a timer created in user memory.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void static_callback(soft_timer_t* timer);
+
+/**
+ * @brief Checks that creating a timer in reused user memory leaves the timer holding its old id queued.
+ */
+static void static_timers_check(void);
+
+/**
+ * @brief Counts timeouts and dropped periods of the catch up timer.
+ *
+ * @param timer Pointer to expired timer.
+ */
+static void catch_up_callback(soft_timer_t* timer);
+
+/**
+ * @brief Checks timeouts of each catch up policy after time jumps over many periods.
+ */
+static void catch_up_check(void);
+
+/**
+ * @brief Calls deferred callbacks, if enabled.
+ */
+static void test_dispatch(void);
+
+/**
+ * @brief Records a failure.
+ *
+ * @param p_model Timer that failed.
+ * @param p_what  Description of the failure.
+ */
+static void test_fail(const model_timer_t* p_model, const char* p_what);
+
+/**
+ * @brief Gets a random value in a range.
+ *
+ * @param low  Smallest value.
+ * @param high Largest value.
+ *
+ * @return Random value from low to high.
+ */
+static uint32_t random_range(uint32_t low, uint32_t high);
+
+/*****************************************
+ * Private Variables
+ *****************************************/
+
+static soft_timer_host_timer_t m_host_timer;
+static model_timer_t m_model[TEST_TIMERS];
+static uint32_t m_failures;
+static uint64_t m_fires;
+static uint32_t m_static_fires;
+static uint32_t m_catch_up_fires;
+static uint32_t m_catch_up_overruns;
+
+static uint32_t m_order_time;
+static uint8_t m_order_priority;
+
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+static soft_timer_storage_t m_storage[SOFT_TIMER_MAX_STATIC_TIMERS];
+#endif
+
+/*****************************************
+ * Main Function
+ *****************************************/
+
+int main(void) {
+    srand(TEST_SEED);
+
+    // 16 bit counter, so the time base crosses many overflows
+    soft_timer_init(&m_host_timer, TEST_COUNTER);
+    static_timers_check();
+    catch_up_check();
+
+    for (uint16_t i = 0; i < TEST_TIMERS; i++) {
+        m_model[i].p_timer = test_timer_create(i);
+
+        if (m_model[i].p_timer == NULL) {
+            printf("FAIL: timer %u not created\n", i);
+            return EXIT_FAILURE;
+        }
+
+        m_model[i].priority = i % SOFT_TIMER_PRIORITY_LEVELS;
+        m_model[i].called = soft_timer_now() - 1;
+        soft_timer_context_set(m_model[i].p_timer, &m_model[i]);
+
+        if (soft_timer_priority_set(m_model[i].p_timer, m_model[i].priority) != SOFT_TIMER_STATUS_SUCCESS) {
+            test_fail(&m_model[i], "priority rejected");
+        }
+    }
+
+    for (uint32_t step = 0; (step < TEST_STEPS) && (m_failures == 0); step++) {
+        model_timer_t* p_model = &m_model[random_range(0, TEST_TIMERS - 1)];
+        uint32_t now = soft_timer_now();
+        uint32_t action = random_range(0, 9);
+
+        if (!p_model->running) {
+            model_start(p_model);
+        } else if (action < 3) {
+            if (soft_timer_stop(p_model->p_timer) != SOFT_TIMER_STATUS_SUCCESS) {
+                test_fail(p_model, "stop rejected");
+            }
+
+            p_model->running = false;
+        } else if (action < 5) {
+            if (soft_timer_restart(p_model->p_timer) != SOFT_TIMER_STATUS_SUCCESS) {
+                test_fail(p_model, "restart rejected");
+            }
+
+            p_model->due = now + p_model->reload;
+        } else if (action < 7) {
+            uint32_t period = random_range(1, 300);
+            bool immediate = random_range(0, 1) != 0;
+
+            if (soft_timer_set_period_ticks(p_model->p_timer, period, immediate) != SOFT_TIMER_STATUS_SUCCESS) {
+                test_fail(p_model, "period rejected");
+            }
+
+            // Immediate change keeps the period start, a timeout already passed is due now
+            if (immediate) {
+                p_model->due = p_model->due - p_model->reload + period;
+
+                if ((int32_t) (p_model->due - now) < 0) {
+                    p_model->due = now;
+                }
+            }
+
+            p_model->reload = period;
+        }
+
+        // Mostly short steps, with long ones crossing many timeouts at once
+        uint32_t ticks = (random_range(0, 15) == 0) ? random_range(0, 5000) : random_range(0, 40);
+
+        m_order_priority = 0;
+        soft_timer_host_advance(&m_host_timer, ticks);
+        model_expire();
+        test_dispatch();
+        model_check();
+    }
+
+    printf("%s: %llu timeouts checked, %u failures\n", (m_failures == 0) ? "PASS" : "FAIL",
+           (unsigned long long) m_fires, m_failures);
+
+    return (m_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*****************************************
+ * Private Functions Bodies Definitions
+ *****************************************/
+
+void test_callback(soft_timer_t* timer) {
+    model_timer_t* p_model = soft_timer_context_get(timer);
+    uint32_t now = soft_timer_now();
+
+    m_fires++;
+
+    // Slack wider than the period may time a timer out again on the same tick, in another pass
+    if (p_model->called == now) {
+        m_order_priority = 0;
+    }
+
+    // Callbacks of one pass over expired timers, or of one dispatch, are called highest priority first
+    if ((now == m_order_time) && (p_model->priority < m_order_priority)) {
+        test_fail(p_model, "callback out of priority order");
+    }
+
+    m_order_time = now;
+    m_order_priority = p_model->priority;
+    p_model->called = now;
+
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+    // Timeouts since last dispatch are merged in a single callback
+    if (!p_model->expired) {
+        test_fail(p_model, "callback without timeout");
+    }
+
+    p_model->expired = false;
+#else
+    if (!p_model->running) {
+        test_fail(p_model, "timeout of a stopped timer");
+        return;
+    }
+
+    if (now != model_deadline(p_model)) {
+        test_fail(p_model, "timeout at wrong time");
+    }
+
+    if (p_model->repeat) {
+        p_model->due += p_model->reload;
+    } else {
+        p_model->running = false;
+    }
+#endif
+}
+
+soft_timer_t* test_timer_create(uint16_t index) {
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 0
+    if (index >= SOFT_TIMER_MAX_TIMERS) {
+        return soft_timer_create_static(&m_storage[index - SOFT_TIMER_MAX_TIMERS]);
+    }
+#else
+    (void) index;
+#endif
+
+    return soft_timer_create();
+}
+
+void model_start(model_timer_t* p_model) {
+    uint32_t now = soft_timer_now();
+    soft_timer_status_t status;
+
+    // Mostly short reloads, so timeouts often fall on the same tick
+    p_model->reload = (random_range(0, 7) == 0) ? random_range(1, TEST_RELOAD_MAX) : random_range(1, 300);
+    p_model->repeat = random_range(0, 1) != 0;
+    p_model->slack = (random_range(0, 3) == 0) ? random_range(1, TEST_SLACK_MAX) : 0;
+
+    // One millisecond per tick at the default tick frequency
+    if (p_model->slack == 0) {
+        status = soft_timer_set_ticks(p_model->p_timer, test_callback, p_model->reload, p_model->repeat);
+    } else {
+        status = soft_timer_set_ex(p_model->p_timer, test_callback, p_model->reload, p_model->repeat, p_model->slack);
+    }
+
+    if (status != SOFT_TIMER_STATUS_SUCCESS) {
+        test_fail(p_model, "set rejected");
+    }
+
+    model_timer_t* p_reference = &m_model[random_range(0, TEST_TIMERS - 1)];
+    uint32_t start = random_range(0, 3);
+    uint32_t deadline;
+
+    if (start == 0) {
+        deadline = now - TEST_START_LATE_MAX + random_range(0, 300);
+        status = soft_timer_start_at(p_model->p_timer, deadline);
+    } else if ((start == 1) && (p_reference != p_model) && p_reference->running) {
+        uint32_t phase = random_range(0, 300);
+
+        // Counted from the previous reference timeout, one period later if already passed
+        if (p_reference->repeat) {
+            deadline = p_reference->due - p_reference->reload + (phase % p_reference->reload);
+
+            if ((int32_t) (deadline - now) <= 0) {
+                deadline += p_reference->reload;
+            }
+        } else {
+            deadline = p_reference->due + phase;
+        }
+
+        status = soft_timer_start_aligned(p_model->p_timer, p_reference->p_timer, phase);
+    } else {
+        deadline = now + p_model->reload;
+        status = soft_timer_start(p_model->p_timer);
+    }
+
+    if (status != SOFT_TIMER_STATUS_SUCCESS) {
+        test_fail(p_model, "start rejected");
+    }
+
+    // Deadline already passed expires right away
+    p_model->running = true;
+    p_model->due = ((int32_t) (deadline - now) < 0) ? now : deadline;
+}
+
+uint32_t model_deadline(const model_timer_t* p_model) {
+    uint32_t latest = p_model->due + p_model->slack;
+    uint32_t differing_bits = p_model->due ^ latest;
+
+    if (differing_bits == 0) {
+        return p_model->due;
+    }
+
+    return latest & ~((1UL << (31 - __builtin_clz(differing_bits))) - 1);
+}
+
+void model_expire(void) {
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+    uint32_t now = soft_timer_now();
+
+    for (uint16_t i = 0; i < TEST_TIMERS; i++) {
+        model_timer_t* p_model = &m_model[i];
+
+        while (p_model->running && ((int32_t) (model_deadline(p_model) - now) <= 0)) {
+            p_model->expired = true;
+
+            if (p_model->repeat) {
+                p_model->due += p_model->reload;
+            } else {
+                p_model->running = false;
+            }
+        }
+    }
+#endif
+}
+
+void model_check(void) {
+    uint32_t now = soft_timer_now();
+
+    for (uint16_t i = 0; i < TEST_TIMERS; i++) {
+        model_timer_t* p_model = &m_model[i];
+
+        if (p_model->running && ((int32_t) (model_deadline(p_model) - now) <= 0)) {
+            test_fail(p_model, "timeout missed");
+        }
+
+        if (p_model->expired) {
+            test_fail(p_model, "callback not dispatched");
+            p_model->expired = false;
+        }
+
+        if (soft_timer_is_stopped(p_model->p_timer) == p_model->running) {
+            test_fail(p_model, "stopped state differs");
+        }
+    }
+}
+
+void static_callback(soft_timer_t* timer) {
+    (void) timer;
+
+    m_static_fires++;
+}
+
+void static_timers_check(void) {
+#if SOFT_TIMER_MAX_STATIC_TIMERS > 1
+    static soft_timer_storage_t storage_a;
+    static soft_timer_storage_t storage_b;
+
+    // Storage is not cleared by the user, so it starts out as garbage
+    memset(&storage_a, TEST_GARBAGE, sizeof(storage_a));
+    memset(&storage_b, TEST_GARBAGE, sizeof(storage_b));
+
+    soft_timer_t* p_timer_a = soft_timer_create_static(&storage_a);
+    soft_timer_destroy(&p_timer_a);
+
+    // Takes the id just released, still written in the storage of the first timer
+    soft_timer_t* p_timer_b = soft_timer_create_static(&storage_b);
+
+    if ((p_timer_b == NULL) ||
+        (soft_timer_set_ticks(p_timer_b, static_callback, TEST_STATIC_TICKS, false) != SOFT_TIMER_STATUS_SUCCESS) ||
+        (soft_timer_start(p_timer_b) != SOFT_TIMER_STATUS_SUCCESS)) {
+        m_failures++;
+        printf("FAIL: static timer not started\n");
+        return;
+    }
+
+    p_timer_a = soft_timer_create_static(&storage_a);
+
+    if (p_timer_a == NULL) {
+        m_failures++;
+        printf("FAIL: static timer not created again\n");
+    }
+
+    soft_timer_host_advance(&m_host_timer, TEST_STATIC_TICKS);
+    test_dispatch();
+
+    if ((m_static_fires != 1) || !soft_timer_is_stopped(p_timer_b)) {
+        m_failures++;
+        printf("FAIL: static timer %lu timeouts, stopped %d\n", (unsigned long) m_static_fires,
+               soft_timer_is_stopped(p_timer_b));
+    }
+
+    soft_timer_destroy(&p_timer_a);
+    soft_timer_destroy(&p_timer_b);
+#endif
+}
+
+void catch_up_callback(soft_timer_t* timer) {
+    m_catch_up_fires++;
+    m_catch_up_overruns += soft_timer_overruns_get(timer);
+}
+
+void catch_up_check(void) {
+    static const soft_timer_catch_up_t policies[] = {SOFT_TIMER_CATCH_UP_BURST, SOFT_TIMER_CATCH_UP_SKIP,
+                                                     SOFT_TIMER_CATCH_UP_REPORT};
+    uint32_t missed = TEST_SLEEP_TICKS / TEST_CATCH_UP_TICKS;
+
+    for (uint8_t i = 0; i < (sizeof(policies) / sizeof(policies[0])); i++) {
+        soft_timer_t* p_timer = soft_timer_create();
+
+        soft_timer_set_ticks(p_timer, catch_up_callback, TEST_CATCH_UP_TICKS, true);
+        soft_timer_catch_up_set(p_timer, policies[i]);
+        soft_timer_start(p_timer);
+
+        m_catch_up_fires = 0;
+        m_catch_up_overruns = 0;
+
+        // Time jumps as after a sleep, over many timeouts at once
+        soft_timer_sleep_compensate_ms(TEST_SLEEP_TICKS);
+        test_dispatch();
+
+        // Deferred timeouts are merged until dispatch, only burst calls back for each one
+        uint32_t expected_fires = 1;
+        uint32_t expected_overruns = (policies[i] == SOFT_TIMER_CATCH_UP_REPORT) ? (missed - 1) : 0;
+
+        if ((policies[i] == SOFT_TIMER_CATCH_UP_BURST) && !SOFT_TIMER_DEFERRED_CALLBACKS) {
+            expected_fires = missed;
+        }
+
+        // Every policy keeps the period phase, next timeout is the first boundary still ahead
+        soft_timer_host_advance(&m_host_timer, ((missed + 1) * TEST_CATCH_UP_TICKS) - TEST_SLEEP_TICKS - 1);
+        test_dispatch();
+
+        uint32_t fires_before_boundary = m_catch_up_fires;
+
+        soft_timer_host_advance(&m_host_timer, 1);
+        test_dispatch();
+
+        if ((fires_before_boundary != expected_fires) || (m_catch_up_fires != (expected_fires + 1)) ||
+            (m_catch_up_overruns != expected_overruns)) {
+            m_failures++;
+            printf("FAIL: catch up policy %u %lu timeouts %lu overruns\n", policies[i],
+                   (unsigned long) fires_before_boundary, (unsigned long) m_catch_up_overruns);
+        }
+
+        soft_timer_stop(p_timer);
+        soft_timer_destroy(&p_timer);
+    }
+}
+
+void test_dispatch(void) {
+#if SOFT_TIMER_DEFERRED_CALLBACKS
+    m_order_priority = 0;
+    soft_timer_dispatch();
+#endif
+}
+
+void test_fail(const model_timer_t* p_model, const char* p_what) {
+    m_failures++;
+
+    printf("FAIL: timer %d %s, now %lu due %lu reload %lu repeat %d\n", (int) (p_model - m_model), p_what,
+           (unsigned long) soft_timer_now(), (unsigned long) p_model->due, (unsigned long) p_model->reload,
+           p_model->repeat);
+}
+
+uint32_t random_range(uint32_t low, uint32_t high) {
+    uint32_t value = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+
+    return low + (value % (high - low + 1));
+}